@@ -0,0 +1,199 @@
+// 對齊矩陣回歸測試：閉式解 getAffineMatrix / getAffineMatrices 與原本 200 次迭代的解法
+// 在固定與隨機的五點組上比較，模板點經兩個矩陣映射後的差距須在容許範圍內
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "base.h"
+
+// 原本的迭代解法，保留作為比較基準
+static void getAffineMatrixIterative(float* src_5pts, const float* dst_5pts, float* M)
+{
+    float src[10], dst[10];
+    memcpy(src, src_5pts, sizeof(float)*10);
+    memcpy(dst, dst_5pts, sizeof(float)*10);
+
+    float ptmp[2];
+    ptmp[0] = ptmp[1] = 0;
+    for (int i = 0; i < 5; ++i) {
+        ptmp[0] += src[i];
+        ptmp[1] += src[5+i];
+    }
+    ptmp[0] /= 5;
+    ptmp[1] /= 5;
+    for (int i = 0; i < 5; ++i) {
+        src[i] -= ptmp[0];
+        src[5+i] -= ptmp[1];
+        dst[i] -= ptmp[0];
+        dst[5+i] -= ptmp[1];
+    }
+
+    float dst_x = (dst[3]+dst[4]-dst[0]-dst[1])/2, dst_y = (dst[8]+dst[9]-dst[5]-dst[6])/2;
+    float src_x = (src[3]+src[4]-src[0]-src[1])/2, src_y = (src[8]+src[9]-src[5]-src[6])/2;
+    float theta = atan2(dst_x, dst_y) - atan2(src_x, src_y);
+
+    float scale = sqrt(pow(dst_x, 2) + pow(dst_y, 2)) / sqrt(pow(src_x, 2) + pow(src_y, 2));
+    float pts1[10];
+    float pts0[2];
+    float _a = sin(theta), _b = cos(theta);
+    pts0[0] = pts0[1] = 0;
+    for (int i = 0; i < 5; ++i) {
+        pts1[i] = scale*(src[i]*_b + src[i+5]*_a);
+        pts1[i+5] = scale*(-src[i]*_a + src[i+5]*_b);
+        pts0[0] += (dst[i] - pts1[i]);
+        pts0[1] += (dst[i+5] - pts1[i+5]);
+    }
+    pts0[0] /= 5;
+    pts0[1] /= 5;
+
+    float sqloss = 0;
+    for (int i = 0; i < 5; ++i) {
+        sqloss += ((pts0[0]+pts1[i]-dst[i])*(pts0[0]+pts1[i]-dst[i])
+                + (pts0[1]+pts1[i+5]-dst[i+5])*(pts0[1]+pts1[i+5]-dst[i+5]));
+    }
+
+    float square_sum = 0;
+    for (int i = 0; i < 10; ++i) {
+        square_sum += src[i]*src[i];
+    }
+    for (int t = 0; t < 200; ++t) {
+        _a = 0;
+        _b = 0;
+        for (int i = 0; i < 5; ++i) {
+            _a += ((pts0[0]-dst[i])*src[i+5] - (pts0[1]-dst[i+5])*src[i]);
+            _b += ((pts0[0]-dst[i])*src[i] + (pts0[1]-dst[i+5])*src[i+5]);
+        }
+        if (_b < 0) {
+            _b = -_b;
+            _a = -_a;
+        }
+        float _s = sqrt(_a*_a + _b*_b);
+        _b /= _s;
+        _a /= _s;
+
+        for (int i = 0; i < 5; ++i) {
+            pts1[i] = scale*(src[i]*_b + src[i+5]*_a);
+            pts1[i+5] = scale*(-src[i]*_a + src[i+5]*_b);
+        }
+
+        float _scale = 0;
+        for (int i = 0; i < 5; ++i) {
+            _scale += ((dst[i]-pts0[0])*pts1[i] + (dst[i+5]-pts0[1])*pts1[i+5]);
+        }
+        _scale /= (square_sum*scale);
+        for (int i = 0; i < 10; ++i) {
+            pts1[i] *= (_scale / scale);
+        }
+        scale = _scale;
+
+        pts0[0] = pts0[1] = 0;
+        for (int i = 0; i < 5; ++i) {
+            pts0[0] += (dst[i] - pts1[i]);
+            pts0[1] += (dst[i+5] - pts1[i+5]);
+        }
+        pts0[0] /= 5;
+        pts0[1] /= 5;
+
+        float _sqloss = 0;
+        for (int i = 0; i < 5; ++i) {
+            _sqloss += ((pts0[0]+pts1[i]-dst[i])*(pts0[0]+pts1[i]-dst[i])
+                    + (pts0[1]+pts1[i+5]-dst[i+5])*(pts0[1]+pts1[i+5]-dst[i+5]));
+        }
+        if (std::abs(_sqloss - sqloss) < 1e-2) {
+            break;
+        }
+        sqloss = _sqloss;
+    }
+
+    M[0] = _b*scale;
+    M[1] = _a*scale;
+    M[3] = -_a*scale;
+    M[4] = _b*scale;
+    M[2] = pts0[0] + ptmp[0] - scale*(ptmp[0]*_b + ptmp[1]*_a);
+    M[5] = pts0[1] + ptmp[1] - scale*(-ptmp[0]*_a + ptmp[1]*_b);
+}
+
+// 112x112 ArcFace 模板 (x 已加 8)
+static const float kTemplate[10] = {38.2946f, 73.5318f, 56.0252f, 41.5493f, 70.7299f,
+                                    51.6963f, 51.5014f, 71.7366f, 92.3655f, 92.2041f};
+
+// 兩個矩陣把五個來源點映射後的最大距離 (像素)
+static float mappedDistance(const float* src, const float* A, const float* B)
+{
+    float worst = 0;
+    for (int i = 0; i < 5; ++i) {
+        float x = src[i], y = src[i+5];
+        float dx = (A[0]*x + A[1]*y + A[2]) - (B[0]*x + B[1]*y + B[2]);
+        float dy = (A[3]*x + A[4]*y + A[5]) - (B[3]*x + B[4]*y + B[5]);
+        worst = std::max(worst, std::sqrt(dx*dx + dy*dy));
+    }
+    return worst;
+}
+
+// 以相似轉換把模板放到影像中，再加上關鍵點雜訊
+static void randomLandmarks(std::mt19937& rng, float* pts)
+{
+    std::uniform_real_distribution<float> angle(-0.6f, 0.6f);
+    std::uniform_real_distribution<float> scale(0.3f, 4.0f);
+    std::uniform_real_distribution<float> offset(0.f, 1500.f);
+    std::normal_distribution<float> noise(0.f, 1.5f);
+    float a = angle(rng), s = scale(rng), tx = offset(rng), ty = offset(rng);
+    float c = std::cos(a) * s, sn = std::sin(a) * s;
+    for (int i = 0; i < 5; ++i) {
+        float x = kTemplate[i] - 56.f, y = kTemplate[i+5] - 56.f;
+        pts[i] = c*x - sn*y + tx + noise(rng) * s;
+        pts[i+5] = sn*x + c*y + ty + noise(rng) * s;
+    }
+}
+
+int main()
+{
+    // 容許誤差：舊解法以損失變化 < 1e-2 停止，並非精確最佳解
+    const float kTolerance = 0.01f;
+    int failures = 0;
+    float worst = 0;
+
+    std::vector<float> sets;
+    // 固定案例：模板本身、正臉、側轉與小臉
+    const float fixed[][10] = {
+        {38.2946f, 73.5318f, 56.0252f, 41.5493f, 70.7299f, 51.6963f, 51.5014f, 71.7366f, 92.3655f, 92.2041f},
+        {412.f, 498.f, 455.f, 420.f, 490.f, 310.f, 308.f, 360.f, 405.f, 402.f},
+        {120.f, 160.f, 130.f, 118.f, 152.f, 90.f, 102.f, 118.f, 140.f, 150.f},
+        {10.f, 19.f, 14.f, 11.f, 18.f, 8.f, 8.f, 13.f, 18.f, 18.f},
+    };
+    for (auto& f : fixed)
+        sets.insert(sets.end(), f, f + 10);
+
+    std::mt19937 rng(12345);
+    for (int k = 0; k < 10000; ++k) {
+        float pts[10];
+        randomLandmarks(rng, pts);
+        sets.insert(sets.end(), pts, pts + 10);
+    }
+
+    int n = (int)(sets.size() / 10);
+    std::vector<float> batched(n * 6);
+    getAffineMatrices(sets.data(), n, kTemplate, batched.data());
+
+    for (int k = 0; k < n; ++k) {
+        float src[10], expected[6], single[6];
+        memcpy(src, &sets[k * 10], sizeof(src));
+        getAffineMatrixIterative(src, kTemplate, expected);
+        getAffineMatrix(src, kTemplate, single);
+
+        float d_single = mappedDistance(src, single, expected);
+        float d_batched = mappedDistance(src, &batched[k * 6], expected);
+        worst = std::max(worst, std::max(d_single, d_batched));
+        if (d_single > kTolerance || d_batched > kTolerance) {
+            if (failures < 10)
+                std::cerr << "Set " << k << ": single " << d_single << " px, batched " << d_batched
+                          << " px from the iterative solver" << std::endl;
+            failures++;
+        }
+    }
+
+    std::cout << n << " landmark sets, max deviation " << worst << " px, " << failures << " failure(s)" << std::endl;
+    return failures ? 1 : 0;
+}
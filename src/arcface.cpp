@@ -1,16 +1,56 @@
 #include "arcface.h"
 #include "config.h"
+#include "pool_allocator.h"
+#include "model_bundle.h"
+#include <algorithm>
+#include <stdexcept>
+
+#if _OPENMP
+#include <omp.h>
+#endif
 
 #if NCNN_VULKAN
 #include "gpu.h"
 #endif // NCNN_VULKAN
 
+// 112x112 對齊模板的五個關鍵點 (x0..x4, y0..y4)
+static void alignmentTemplate(float* dst)
+{
+    int image_w = 112; //96 or 112
+
+    const float base[10] = {30.2946, 65.5318, 48.0252, 33.5493, 62.7299,
+                            51.6963, 51.5014, 71.7366, 92.3655, 92.2041};
+    memcpy(dst, base, sizeof(base));
+
+    if (image_w == 112)
+        for (int i = 0; i < 5; i++)
+            dst[i] += 8.0;
+}
+
+static void landmarkPoints(const FaceInfo& info, float* src)
+{
+    for (int i = 0; i < 5; i++)
+    {
+        src[i] = info.landmark[2 * i];
+        src[i + 5] = info.landmark[2 * i + 1];
+    }
+}
+
+// 由五個關鍵點求出對齊到 112x112 模板的仿射矩陣
+static void alignmentMatrix(const FaceInfo& info, float* M)
+{
+    float dst[10], src[10];
+    alignmentTemplate(dst);
+    landmarkPoints(info, src);
+    getAffineMatrix(src, dst, M);
+}
+
 Arcface::Arcface(std::string model_folder)
 {
     Config& config = Config::getInstance();
 
-    std::string param_file = config.getModelPath(config.arcface_param);
-    std::string bin_file = config.getModelPath(config.arcface_bin);
+    std::string param_file = config.getNetModelPath(config.arcface_param);
+    std::string bin_file = config.getNetModelPath(config.arcface_bin);
     
     this->param_file = param_file;
     this->bin_file = bin_file;
@@ -19,8 +59,24 @@ Arcface::Arcface(std::string model_folder)
     this->net.use_vulkan_compute = true;
 #endif // NCNN_VULKAN
 
-    this->net.load_param(this->param_file.c_str());
-    this->net.load_model(this->bin_file.c_str());
+    applyNetOptions(this->net, config.arcface_options);
+    if (config.arcface_options.num_threads)
+        this->thread_budget = *config.arcface_options.num_threads;
+}
+
+bool Arcface::preload()
+{
+    std::call_once(load_flag, [this]() {
+        loaded = loadNet(this->net, "arcface", this->param_file, this->bin_file);
+    });
+    return loaded;
+}
+
+void Arcface::requireLoaded()
+{
+    // 載入失敗的空網路在 extract 時才會靜默出錯，第一次使用就中止
+    if (!preload())
+        throw std::runtime_error("Failed to load network arcface");
 }
 
 Arcface::~Arcface()
@@ -30,57 +86,150 @@ Arcface::~Arcface()
 
 std::vector<float> Arcface::getFeature(ncnn::Mat img)
 {
-    std::vector<float> feature;
-    ncnn::Mat in = resize(img, 112, 112);
-    in = bgr2rgb(in);
-    ncnn::Extractor ex = net.create_extractor();
-    ex.set_light_mode(true);
-    ex.input("data", in);
-    ncnn::Mat out;
-    ex.extract("fc1", out);
-    feature.resize(this->feature_dim);
-    for (int i = 0; i < this->feature_dim; i++)
-        feature[i] = out[i];
-    normalize(feature);
+    std::vector<float> feature(this->feature_dim);
+    // 輸入與縮放用的張量依執行緒重複使用，穩定後不再配置
+    thread_local ncnn::Mat in, resized;
+    if (img.w == 112 && img.h == 112 && img.c == 3) {
+        // 已對齊的人臉只需交換 R/B 通道，不必經過 112->112 的 resize 與 u8 轉換
+        ensureMat(in, 112, 112);
+        for (int c = 0; c < 3; c++)
+            memcpy(in.channel(c), img.channel(2 - c), 112 * 112 * sizeof(float));
+    } else {
+        resize(img, resized, 112, 112);
+        bgr2rgb(resized, in);
+    }
+    extract(in, feature.data());
     return feature;
 }
 
-void Arcface::normalize(std::vector<float> &feature)
+void Arcface::getFeature(const FrameView& img, const FaceInfo& info, float* feature)
 {
-    float sum = 0;
-    for (auto it = feature.begin(); it != feature.end(); it++)
-        sum += (float)*it * (float)*it;
-    sum = sqrt(sum);
-    for (auto it = feature.begin(); it != feature.end(); it++)
-        *it /= sum;
+    float M[6];
+    alignmentMatrix(info, M);
+    alignAndExtract(img, M, feature);
 }
 
-ncnn::Mat preprocess(ncnn::Mat img, FaceInfo info)
+std::vector<float> Arcface::getFeatures(const FrameView& img, const std::vector<FaceInfo>& infos, int num_threads)
 {
-    int image_w = 112; //96 or 112
-    int image_h = 112;
+    int n = (int)infos.size();
+    std::vector<float> features(n * this->feature_dim);
+    if (n == 0)
+        return features;
 
-    float dst[10] = {30.2946, 65.5318, 48.0252, 33.5493, 62.7299,
-                     51.6963, 51.5014, 71.7366, 92.3655, 92.2041};
+    float dst[10];
+    alignmentTemplate(dst);
+    std::vector<float> src(n * 10), M(n * 6);
+    for (int i = 0; i < n; i++)
+        landmarkPoints(infos[i], &src[i * 10]);
+    getAffineMatrices(src.data(), n, dst, M.data());
 
-    if (image_w == 112)
-        for (int i = 0; i < 5; i++)
-            dst[i] += 8.0;
+    // 在平行區段外確認網路已載入，失敗時的例外不會從 OpenMP 執行緒拋出
+    requireLoaded();
 
-    float src[10];
-    for (int i = 0; i < 5; i++)
-    {
-        src[i] = info.landmark[2 * i];
-        src[i + 5] = info.landmark[2 * i + 1];
+    // 執行緒預算依序取呼叫端的 num_threads、ncnn.arcface.num_threads，都沒有時用全部核心。
+    // 預算先分給平行的人臉，每次前向用平分後的份額；只有一個執行緒處理人臉時不覆寫網路選項
+    int budget = num_threads > 0 ? num_threads : this->thread_budget;
+#if _OPENMP
+    if (budget <= 0)
+        budget = omp_get_max_threads();
+    int threads = std::min(budget, n);
+#else
+    int threads = 1;
+#endif
+    int per_face = threads > 1 ? std::max(1, budget / threads) : (num_threads > 0 ? num_threads : 0);
+
+    // 每個執行緒各自的 extractor 與輸入張量
+    #pragma omp parallel for num_threads(threads) schedule(dynamic)
+    for (int i = 0; i < n; i++)
+        alignAndExtract(img, &M[i * 6], &features[i * this->feature_dim], per_face);
+
+    return features;
+}
+
+void Arcface::alignAndExtract(const FrameView& img, const float* M, float* feature, int num_threads)
+{
+    // 輸入張量依執行緒重複使用，形狀不變時不重新配置
+    thread_local ncnn::Mat in;
+    float m[6];
+    memcpy(m, M, sizeof(m));
+    // 網路輸入為 RGB，對齊時順便交換 R/B，省去 bgr2rgb
+    warpAffineMatrix(img.data, img.w, img.h, img.stride, in, m, 112, 112, true);
+    extract(in, feature, num_threads);
+}
+
+void Arcface::extract(const ncnn::Mat& in, float* feature, int num_threads)
+{
+    requireLoaded();
+    ncnn::Extractor ex = net.create_extractor();
+    useWorkerAllocators(ex);
+    if (num_threads > 0)
+        ex.set_num_threads(num_threads);
+    if (input_observer) {
+        // getFeatures 平行時會從多個執行緒呼叫，依序進入回呼
+        std::lock_guard<std::mutex> lock(observer_mutex);
+        input_observer(in);
     }
+    ex.input("data", in);
+    ncnn::Mat out;
+    ex.extract("fc1", out);
+
+    const float* data = out;
+    float sum = 0;
+    for (int i = 0; i < this->feature_dim; i++)
+        sum += data[i] * data[i];
+    float inv = 1.f / sqrt(sum);
+    for (int i = 0; i < this->feature_dim; i++)
+        feature[i] = data[i] * inv;
+}
 
+ncnn::Mat preprocess(ncnn::Mat img, FaceInfo info)
+{
     float M[6];
-    getAffineMatrix(src, dst, M);
+    alignmentMatrix(info, M);
+    ncnn::Mat out;
+    warpAffineMatrix(img, out, M, 112, 112);
+    return out;
+}
+
+ncnn::Mat preprocess(const FrameView& img, FaceInfo info)
+{
     ncnn::Mat out;
-    warpAffineMatrix(img, out, M, image_w, image_h);
+    preprocess(img, info, out);
     return out;
 }
 
+std::vector<ncnn::Mat> preprocess(const FrameView& img, const std::vector<FaceInfo>& infos)
+{
+    std::vector<ncnn::Mat> faces;
+    preprocess(img, infos, faces);
+    return faces;
+}
+
+void preprocess(const FrameView& img, const FaceInfo& info, ncnn::Mat& face)
+{
+    float M[6];
+    alignmentMatrix(info, M);
+    warpAffineMatrix(img.data, img.w, img.h, img.stride, face, M, 112, 112);
+}
+
+void preprocess(const FrameView& img, const std::vector<FaceInfo>& infos, std::vector<ncnn::Mat>& faces)
+{
+    // 同一幀的所有人臉一次求出仿射矩陣，模板只需去中心化一次
+    int n = (int)infos.size();
+    float dst[10];
+    alignmentTemplate(dst);
+    std::vector<float> src(n * 10), M(n * 6);
+    for (int i = 0; i < n; i++)
+        landmarkPoints(infos[i], &src[i * 10]);
+    getAffineMatrices(src.data(), n, dst, M.data());
+
+    // 多出的張量保留給之後人臉較多的幀
+    if ((int)faces.size() < n)
+        faces.resize(n);
+    for (int i = 0; i < n; i++)
+        warpAffineMatrix(img.data, img.w, img.h, img.stride, faces[i], &M[i * 6], 112, 112);
+}
+
 float calcSimilar(std::vector<float> feature1, std::vector<float> feature2)
 {
     //assert(feature1.size() == feature2.size());
@@ -4,30 +4,58 @@
 #include <cmath>
 #include <vector>
 #include <string>
+#include <functional>
+#include <mutex>
 #include "net.h"
 #include "base.h"
 
 
 ncnn::Mat preprocess(ncnn::Mat img, FaceInfo info);
 
+// 直接從 8-bit BGR 影格對齊，不需先把整張影像轉成 ncnn::Mat 再轉回像素
+ncnn::Mat preprocess(const FrameView& img, FaceInfo info);
+std::vector<ncnn::Mat> preprocess(const FrameView& img, const std::vector<FaceInfo>& infos);
+
+// 寫入呼叫端持有的張量，跨幀重複使用時不再配置；faces 不會縮小，只有前 infos.size() 個是本幀的結果
+void preprocess(const FrameView& img, const FaceInfo& info, ncnn::Mat& face);
+void preprocess(const FrameView& img, const std::vector<FaceInfo>& infos, std::vector<ncnn::Mat>& faces);
+
 float calcSimilar(std::vector<float> feature1, std::vector<float> feature2);
 
 
 class Arcface {
 
 public:
+    // 建構時只記錄模型路徑，第一次提取特徵時才載入網路
     Arcface(std::string model_folder = "");
     ~Arcface();
+    // 載入網路，失敗時回傳 false
+    bool preload();
     std::vector<float> getFeature(ncnn::Mat img);
+    // 從原圖直接對齊到網路輸入張量，正規化後的特徵寫入 feature (需 getFeatureDim() 個元素)
+    void getFeature(const FrameView& img, const FaceInfo& info, float* feature);
+    // 同一幀的所有人臉平行提取特徵，回傳連續的 M x feature_dim 矩陣 (第 i 列對應 infos[i])
+    // num_threads 為總執行緒數，0 時依 ncnn.arcface.num_threads，未設定時使用全部核心
+    std::vector<float> getFeatures(const FrameView& img, const std::vector<FaceInfo>& infos, int num_threads = 0);
+    int getFeatureDim() const { return feature_dim; }
+
+    // 前向前回呼網路輸入，供 int8 校正收集資料；平行提取時以互斥鎖依序呼叫
+    std::function<void(const ncnn::Mat&)> input_observer;
 
 private:
     ncnn::Net net;
     std::string param_file;
     std::string bin_file;
+    std::once_flag load_flag;
+    bool loaded = false;           // 由 load_flag 保護，載入後唯讀
+    std::mutex observer_mutex;
+    int thread_budget = 0;         // ncnn.arcface.num_threads，未設定時為 0
 
     const int feature_dim = 128;
 
-    void normalize(std::vector<float> &feature);
+    void requireLoaded();          // 載入失敗時拋出 runtime_error
+    void extract(const ncnn::Mat& in, float* feature, int num_threads = 0);
+    void alignAndExtract(const FrameView& img, const float* M, float* feature, int num_threads = 0);
 };
 
 #endif
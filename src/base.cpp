@@ -1,45 +1,143 @@
 #include "base.h"
+#include "scratch_arena.h"
+#include <vector>
+#include <algorithm>
+
+#if __SSE2__
+#include <emmintrin.h>
+#endif
+#if __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+void applyNetOptions(ncnn::Net& net, const NetOptions& options)
+{
+    if (options.num_threads && *options.num_threads > 0)
+        net.opt.num_threads = *options.num_threads;
+    if (options.lightmode)
+        net.opt.lightmode = *options.lightmode;
+    if (options.use_packing_layout)
+        net.opt.use_packing_layout = *options.use_packing_layout;
+    if (options.use_fp16_packed)
+        net.opt.use_fp16_packed = *options.use_fp16_packed;
+    if (options.use_fp16_storage)
+        net.opt.use_fp16_storage = *options.use_fp16_storage;
+    if (options.use_fp16_arithmetic)
+        net.opt.use_fp16_arithmetic = *options.use_fp16_arithmetic;
+    if (options.use_winograd_convolution)
+        net.opt.use_winograd_convolution = *options.use_winograd_convolution;
+    if (options.use_sgemm_convolution)
+        net.opt.use_sgemm_convolution = *options.use_sgemm_convolution;
+}
+
+void ensureMat(ncnn::Mat& dst, int w, int h, int c)
+{
+    if (!dst.empty() && dst.dims == 3 && dst.w == w && dst.h == h && dst.c == c && dst.elemsize == 4 && dst.elempack == 1)
+        return;
+    dst.create(w, h, c);
+    scratchArena().countMatAllocation();
+}
+
+// 交錯的 8-bit 像素轉成逐通道的 float，等同 from_pixels(PIXEL_RGB) 但寫入既有的 dst
+static void pixelsToMat(const unsigned char* pixels, int w, int h, ncnn::Mat& dst)
+{
+    ensureMat(dst, w, h);
+    int size = w * h;
+    for (int c = 0; c < 3; c++) {
+        float* out = dst.channel(c);
+        for (int i = 0; i < size; i++)
+            out[i] = pixels[i * 3 + c];
+    }
+}
+
+ncnn::Mat cropResize(const FrameView& img, int x0, int y0, int x1, int y1, int w, int h)
+{
+    ncnn::Mat dst;
+    cropResize(img, x0, y0, x1, y1, w, h, dst);
+    return dst;
+}
+
+void cropResize(const FrameView& img, int x0, int y0, int x1, int y1, int w, int h, ncnn::Mat& dst)
+{
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    x1 = std::min(x1, img.w);
+    y1 = std::min(y1, img.h);
+    if (x1 <= x0 || y1 <= y0) {
+        ensureMat(dst, w, h);
+        dst.fill(0.f);
+        return;
+    }
+    // 與 from_pixels_roi_resize 相同：在來源上直接縮放子區域，再展開成逐通道的 float
+    ScratchArena::Scope scope(scratchArena());
+    unsigned char* pixels = scratchArena().allocate<unsigned char>(w * h * 3);
+    ncnn::resize_bilinear_c3(img.data + y0 * img.stride + x0 * 3, x1 - x0, y1 - y0, img.stride, pixels, w, h, w * 3);
+    pixelsToMat(pixels, w, h, dst);
+}
+
+void scaleFaces(std::vector<FaceInfo>& faces, float sx, float sy)
+{
+    for (auto it = faces.begin(); it != faces.end(); it++) {
+        for (int k = 0; k < 2; k++) {
+            it->x[k] = (int)round(it->x[k] * sx);
+            it->y[k] = (int)round(it->y[k] * sy);
+        }
+        for (int p = 0; p < 5; p++) {
+            it->landmark[2 * p] = (int)round(it->landmark[2 * p] * sx);
+            it->landmark[2 * p + 1] = (int)round(it->landmark[2 * p + 1] * sy);
+        }
+        it->area = (it->x[1] - it->x[0]) * (it->y[1] - it->y[0]);
+    }
+}
 
 ncnn::Mat resize(ncnn::Mat src, int w, int h)
+{
+    ncnn::Mat dst;
+    resize(src, dst, w, h);
+    return dst;
+}
+
+void resize(const ncnn::Mat& src, ncnn::Mat& dst, int w, int h)
 {
     int src_w = src.w;
     int src_h = src.h;
-    unsigned char* u_src = new unsigned char[src_w * src_h * 3];
+    ScratchArena::Scope scope(scratchArena());
+    unsigned char* u_src = scratchArena().allocate<unsigned char>(src_w * src_h * 3);
     src.to_pixels(u_src, ncnn::Mat::PIXEL_RGB);
-    unsigned char* u_dst = new unsigned char[w * h * 3];
+    unsigned char* u_dst = scratchArena().allocate<unsigned char>(w * h * 3);
     ncnn::resize_bilinear_c3(u_src, src_w, src_h, u_dst, w, h);
-    ncnn::Mat dst = ncnn::Mat::from_pixels(u_dst, ncnn::Mat::PIXEL_RGB, w, h);
-    delete[] u_src;
-    delete[] u_dst;
-    return dst;
+    pixelsToMat(u_dst, w, h, dst);
 }
 
 cv::Mat ncnn2cv(ncnn::Mat img)
 {
-    unsigned char pix[img.h * img.w * 3];
-    img.to_pixels(pix, ncnn::Mat::PIXEL_BGR);
-    cv::Mat cv_img(img.h, img.w, CV_8UC3);
-    for (int i = 0; i < cv_img.rows; i++)
-    {
-        for (int j = 0; j < cv_img.cols; j++)
-        {
-            cv_img.at<cv::Vec3b>(i,j)[0] = pix[3 * (i * cv_img.cols + j)];
-            cv_img.at<cv::Vec3b>(i,j)[1] = pix[3 * (i * cv_img.cols + j) + 1];
-            cv_img.at<cv::Vec3b>(i,j)[2] = pix[3 * (i * cv_img.cols + j) + 2];
-        }
-    }
+    cv::Mat cv_img;
+    ncnn2cv(img, cv_img);
     return cv_img;
 }
 
+void ncnn2cv(const ncnn::Mat& img, cv::Mat& dst)
+{
+    // 尺寸與型別相同時 create 不會重新配置，直接以 to_pixels 寫入 dst 的緩衝區
+    dst.create(img.h, img.w, CV_8UC3);
+    img.to_pixels(dst.data, ncnn::Mat::PIXEL_BGR, (int)dst.step);
+}
+
 ncnn::Mat bgr2rgb(ncnn::Mat src)
+{
+    ncnn::Mat dst;
+    bgr2rgb(src, dst);
+    return dst;
+}
+
+void bgr2rgb(const ncnn::Mat& src, ncnn::Mat& dst)
 {
     int src_w = src.w;
     int src_h = src.h;
-    unsigned char* u_rgb = new unsigned char[src_w * src_h * 3];
+    ScratchArena::Scope scope(scratchArena());
+    unsigned char* u_rgb = scratchArena().allocate<unsigned char>(src_w * src_h * 3);
     src.to_pixels(u_rgb, ncnn::Mat::PIXEL_BGR2RGB);
-    ncnn::Mat dst = ncnn::Mat::from_pixels(u_rgb, ncnn::Mat::PIXEL_RGB, src_w, src_h);
-    delete[] u_rgb;
-    return dst;
+    pixelsToMat(u_rgb, src_w, src_h, dst);
 }
 
 ncnn::Mat rgb2bgr(ncnn::Mat src)
@@ -47,127 +145,154 @@ ncnn::Mat rgb2bgr(ncnn::Mat src)
     return bgr2rgb(src);
 }
 
-void getAffineMatrix(float* src_5pts, const float* dst_5pts, float* M)
+int thresholdIndices(const float* data, int size, float thresh, int* indices)
 {
-    float src[10], dst[10];
-    memcpy(src, src_5pts, sizeof(float)*10);
-    memcpy(dst, dst_5pts, sizeof(float)*10);
-
-    float ptmp[2];
-    ptmp[0] = ptmp[1] = 0;
-    for (int i = 0; i < 5; ++i) {
-        ptmp[0] += src[i];
-        ptmp[1] += src[5+i];
+    int count = 0;
+    int i = 0;
+#if __SSE2__
+    __m128 _thresh = _mm_set1_ps(thresh);
+    for (; i + 15 < size; i += 16)
+    {
+        int m0 = _mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(data + i), _thresh));
+        int m1 = _mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(data + i + 4), _thresh));
+        int m2 = _mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(data + i + 8), _thresh));
+        int m3 = _mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(data + i + 12), _thresh));
+        int mask = m0 | (m1 << 4) | (m2 << 8) | (m3 << 12);
+        while (mask)
+        {
+            indices[count++] = i + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
     }
-    ptmp[0] /= 5;
-    ptmp[1] /= 5;
-    for (int i = 0; i < 5; ++i) {
-        src[i] -= ptmp[0];
-        src[5+i] -= ptmp[1];
-        dst[i] -= ptmp[0];
-        dst[5+i] -= ptmp[1];
+#elif __ARM_NEON && __aarch64__
+    float32x4_t _thresh = vdupq_n_f32(thresh);
+    for (; i + 3 < size; i += 4)
+    {
+        uint32x4_t _mask = vcgtq_f32(vld1q_f32(data + i), _thresh);
+        if (vmaxvq_u32(_mask) == 0)
+            continue;
+        for (int k = 0; k < 4; k++)
+            if (data[i + k] > thresh)
+                indices[count++] = i + k;
     }
+#endif
+    // 其他架構 (包含 RISC-V) 沒有向量版本，全部走以下純量迴圈
+    for (; i < size; i++)
+        if (data[i] > thresh)
+            indices[count++] = i;
+    return count;
+}
 
-    float dst_x = (dst[3]+dst[4]-dst[0]-dst[1])/2, dst_y = (dst[8]+dst[9]-dst[5]-dst[6])/2;
-    float src_x = (src[3]+src[4]-src[0]-src[1])/2, src_y = (src[8]+src[9]-src[5]-src[6])/2;
-    float theta = atan2(dst_x, dst_y) - atan2(src_x, src_y);
-
-    float scale = sqrt(pow(dst_x, 2) + pow(dst_y, 2)) / sqrt(pow(src_x, 2) + pow(src_y, 2));
-    float pts1[10];
-    float pts0[2];
-    float _a = sin(theta), _b = cos(theta);
-    pts0[0] = pts0[1] = 0;
+// 五點相似轉換的最小平方閉式解 (Umeyama，2D 無反射)：
+// u = c*x + s*y + tx, v = -s*x + c*y + ty，c、s 由去中心化後的內積直接求得
+static void similarityFromCentered(const float* src, float src_mx, float src_my,
+                                   const float* dst_c, float dst_mx, float dst_my, float* M)
+{
+    float sxx = 0, num_c = 0, num_s = 0;
     for (int i = 0; i < 5; ++i) {
-        pts1[i] = scale*(src[i]*_b + src[i+5]*_a);
-        pts1[i+5] = scale*(-src[i]*_a + src[i+5]*_b);
-        pts0[0] += (dst[i] - pts1[i]);
-        pts0[1] += (dst[i+5] - pts1[i+5]);
+        float x = src[i] - src_mx, y = src[i+5] - src_my;
+        sxx += x*x + y*y;
+        num_c += x*dst_c[i] + y*dst_c[i+5];
+        num_s += y*dst_c[i] - x*dst_c[i+5];
     }
-    pts0[0] /= 5;
-    pts0[1] /= 5;
+    float c = sxx > 0 ? num_c / sxx : 0;
+    float s = sxx > 0 ? num_s / sxx : 0;
 
-    float sqloss = 0;
+    M[0] = c;
+    M[1] = s;
+    M[3] = -s;
+    M[4] = c;
+    M[2] = dst_mx - (c*src_mx + s*src_my);
+    M[5] = dst_my - (-s*src_mx + c*src_my);
+}
+
+// 目標模板的中心與去中心化座標，批次處理時只需算一次
+static void centerPoints(const float* pts, float* centered, float& mx, float& my)
+{
+    mx = my = 0;
     for (int i = 0; i < 5; ++i) {
-        sqloss += ((pts0[0]+pts1[i]-dst[i])*(pts0[0]+pts1[i]-dst[i])
-                + (pts0[1]+pts1[i+5]-dst[i+5])*(pts0[1]+pts1[i+5]-dst[i+5]));
+        mx += pts[i];
+        my += pts[5+i];
     }
-
-    float square_sum = 0;
-    for (int i = 0; i < 10; ++i) {
-        square_sum += src[i]*src[i];
+    mx /= 5;
+    my /= 5;
+    for (int i = 0; i < 5; ++i) {
+        centered[i] = pts[i] - mx;
+        centered[5+i] = pts[5+i] - my;
     }
-    for (int t = 0; t < 200; ++t) {
-        _a = 0;
-        _b = 0;
-        for (int i = 0; i < 5; ++i) {
-            _a += ((pts0[0]-dst[i])*src[i+5] - (pts0[1]-dst[i+5])*src[i]);
-            _b += ((pts0[0]-dst[i])*src[i] + (pts0[1]-dst[i+5])*src[i+5]);
-        }
-        if (_b < 0) {
-            _b = -_b;
-            _a = -_a;
-        }
-        float _s = sqrt(_a*_a + _b*_b);
-        _b /= _s;
-        _a /= _s;
-
-        for (int i = 0; i < 5; ++i) {
-            pts1[i] = scale*(src[i]*_b + src[i+5]*_a);
-            pts1[i+5] = scale*(-src[i]*_a + src[i+5]*_b);
-        }
+}
 
-        float _scale = 0;
-        for (int i = 0; i < 5; ++i) {
-            _scale += ((dst[i]-pts0[0])*pts1[i] + (dst[i+5]-pts0[1])*pts1[i+5]);
-        }
-        _scale /= (square_sum*scale);
-        for (int i = 0; i < 10; ++i) {
-            pts1[i] *= (_scale / scale);
-        }
-        scale = _scale;
+void getAffineMatrix(float* src_5pts, const float* dst_5pts, float* M)
+{
+    getAffineMatrices(src_5pts, 1, dst_5pts, M);
+}
 
-        pts0[0] = pts0[1] = 0;
-        for (int i = 0; i < 5; ++i) {
-            pts0[0] += (dst[i] - pts1[i]);
-            pts0[1] += (dst[i+5] - pts1[i+5]);
-        }
-        pts0[0] /= 5;
-        pts0[1] /= 5;
+void getAffineMatrices(const float* src_5pts, int n, const float* dst_5pts, float* M)
+{
+    float dst_c[10], dst_mx, dst_my;
+    centerPoints(dst_5pts, dst_c, dst_mx, dst_my);
 
-        float _sqloss = 0;
+    for (int k = 0; k < n; ++k) {
+        const float* src = src_5pts + 10*k;
+        float src_mx = 0, src_my = 0;
         for (int i = 0; i < 5; ++i) {
-            _sqloss += ((pts0[0]+pts1[i]-dst[i])*(pts0[0]+pts1[i]-dst[i])
-                    + (pts0[1]+pts1[i+5]-dst[i+5])*(pts0[1]+pts1[i+5]-dst[i+5]));
-        }
-        if (abs(_sqloss - sqloss) < 1e-2) {
-            break;
+            src_mx += src[i];
+            src_my += src[5+i];
         }
-        sqloss = _sqloss;
-    }
-
-    for (int i = 0; i < 5; ++i) {
-        pts1[i] += (pts0[0] + ptmp[0]);
-        pts1[i+5] += (pts0[1] + ptmp[1]);
+        similarityFromCentered(src, src_mx / 5, src_my / 5, dst_c, dst_mx, dst_my, M + 6*k);
     }
-
-    M[0] = _b*scale;
-    M[1] = _a*scale;
-    M[3] = -_a*scale;
-    M[4] = _b*scale;
-    M[2] = pts0[0] + ptmp[0] - scale*(ptmp[0]*_b + ptmp[1]*_a);
-    M[5] = pts0[1] + ptmp[1] - scale*(-ptmp[0]*_a + ptmp[1]*_b);
 }
 
 void warpAffineMatrix(ncnn::Mat src, ncnn::Mat &dst, float *M, int dst_w, int dst_h)
 {
-    int src_w = src.w;
-    int src_h = src.h;
+    ScratchArena::Scope scope(scratchArena());
+    unsigned char* src_u = scratchArena().allocate<unsigned char>(src.w * src.h * 3);
+    src.to_pixels(src_u, ncnn::Mat::PIXEL_BGR);
+    warpAffineMatrix(src_u, src.w, src.h, src.w * 3, dst, M, dst_w, dst_h);
+}
 
-    unsigned char * src_u = new unsigned char[src_w * src_h * 3]{0};
-    unsigned char * dst_u = new unsigned char[dst_w * dst_h * 3]{0};
-    
-    src.to_pixels(src_u, ncnn::Mat::PIXEL_RGB);
+// 一列輸出的雙線性混合：先水平 (11-bit 權重，右移 4 位保留在 int16 範圍)，再垂直
+// row0/row1 為上下兩列 (左, 右) 交錯的像素值，wx/wy 為對應的交錯權重
+static void blendRow(const short* row0, const short* row1, const short* wx, const short* wy, float* out, int n)
+{
+    int x = 0;
+#if __SSE2__
+    const __m128i _delta4 = _mm_set1_epi32(1 << 3);
+    const __m128i _delta18 = _mm_set1_epi32(1 << 17);
+    for (; x + 4 <= n; x += 4) {
+        __m128i _wx = _mm_loadu_si128((const __m128i*)(wx + 2 * x));
+        __m128i _h0 = _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(row0 + 2 * x)), _wx);
+        __m128i _h1 = _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(row1 + 2 * x)), _wx);
+        _h0 = _mm_srai_epi32(_mm_add_epi32(_h0, _delta4), 4);
+        _h1 = _mm_srai_epi32(_mm_add_epi32(_h1, _delta4), 4);
+        __m128i _h = _mm_packs_epi32(_h0, _h1);
+        __m128i _hv = _mm_unpacklo_epi16(_h, _mm_srli_si128(_h, 8));
+        __m128i _v = _mm_madd_epi16(_hv, _mm_loadu_si128((const __m128i*)(wy + 2 * x)));
+        _v = _mm_srai_epi32(_mm_add_epi32(_v, _delta18), 18);
+        _mm_storeu_ps(out + x, _mm_cvtepi32_ps(_v));
+    }
+#elif __ARM_NEON
+    for (; x + 4 <= n; x += 4) {
+        int16x4x2_t _wx = vld2_s16(wx + 2 * x);
+        int16x4x2_t _r0 = vld2_s16(row0 + 2 * x);
+        int16x4x2_t _r1 = vld2_s16(row1 + 2 * x);
+        int16x4_t _h0 = vrshrn_n_s32(vmlal_s16(vmull_s16(_r0.val[0], _wx.val[0]), _r0.val[1], _wx.val[1]), 4);
+        int16x4_t _h1 = vrshrn_n_s32(vmlal_s16(vmull_s16(_r1.val[0], _wx.val[0]), _r1.val[1], _wx.val[1]), 4);
+        int16x4x2_t _wy = vld2_s16(wy + 2 * x);
+        int32x4_t _v = vrshrq_n_s32(vmlal_s16(vmull_s16(_h0, _wy.val[0]), _h1, _wy.val[1]), 18);
+        vst1q_f32(out + x, vcvtq_f32_s32(_v));
+    }
+#endif
+    // 其他架構 (包含 RISC-V) 沒有向量版本，全部走以下純量迴圈
+    for (; x < n; x++) {
+        int h0 = (row0[2 * x] * wx[2 * x] + row0[2 * x + 1] * wx[2 * x + 1] + (1 << 3)) >> 4;
+        int h1 = (row1[2 * x] * wx[2 * x] + row1[2 * x + 1] * wx[2 * x + 1] + (1 << 3)) >> 4;
+        out[x] = (float)((h0 * wy[2 * x] + h1 * wy[2 * x + 1] + (1 << 17)) >> 18);
+    }
+}
 
+void warpAffineMatrix(const unsigned char* src, int src_w, int src_h, int stride, ncnn::Mat& dst, float* M, int dst_w, int dst_h, bool swap_rb)
+{
     float m[6];
     for (int i = 0; i < 6; i++)
         m[i] = M[i];
@@ -180,45 +305,72 @@ void warpAffineMatrix(ncnn::Mat src, ncnn::Mat &dst, float *M, int dst_w, int ds
     float b2 = -m[3] * m[2] - m[4] * m[5];
     m[2] = b1; m[5] = b2;
 
-    for (int y= 0; y < dst_h; y++)
+    // 輸出四角反推回來源的外接矩形，完全落在影像內時省去逐像素邊界檢查。
+    // 逐像素座標與四角的計算順序不同，浮點誤差可能差到跨過整數，因此四周多留一像素
+    float min_x = m[2], max_x = m[2], min_y = m[5], max_y = m[5];
+    for (int k = 1; k < 4; k++) {
+        float cx = (k & 1) ? dst_w - 1 : 0;
+        float cy = (k & 2) ? dst_h - 1 : 0;
+        float fx = m[0] * cx + m[1] * cy + m[2];
+        float fy = m[3] * cx + m[4] * cy + m[5];
+        min_x = std::min(min_x, fx); max_x = std::max(max_x, fx);
+        min_y = std::min(min_y, fy); max_y = std::max(max_y, fy);
+    }
+    bool inside = min_x >= 1 && min_y >= 1 && max_x < src_w - 2 && max_y < src_h - 2;
+
+    ensureMat(dst, dst_w, dst_h);
+
+    // 每列的位移、權重與像素暫存取自執行緒區域暫存區
+    ScratchArena& arena = scratchArena();
+    ScratchArena::Scope scope(arena);
+    int* ofs = arena.allocate<int>(dst_w);
+    short* wx = arena.allocate<short>(dst_w * 2);
+    short* wy = arena.allocate<short>(dst_w * 2);
+    short* row0 = arena.allocate<short>(dst_w * 2);
+    short* row1 = arena.allocate<short>(dst_w * 2);
+
+    for (int y = 0; y < dst_h; y++)
     {
+        // 本列每個輸出像素在來源的左上角位移與定點權重，超出範圍的像素輸出 0
         for (int x = 0; x < dst_w; x++)
         {
             float fx = m[0] * x + m[1] * y + m[2];
             float fy = m[3] * x + m[4] * y + m[5];
-
-            int sy = (int)floor(fy);
-            fy -= sy;
-            if (sy < 0 || sy >= src_h) continue;
-
-            short cbufy[2];
-            cbufy[0] = (short)((1.f - fy) * 2048);
-            cbufy[1] = 2048 - cbufy[0];
-
             int sx = (int)floor(fx);
+            int sy = (int)floor(fy);
             fx -= sx;
-            if (sx < 0 || sx >= src_w) continue;
-
-            short cbufx[2];
-            cbufx[0] = (short)((1.f - fx) * 2048);
-            cbufx[1] = 2048 - cbufx[0];
+            fy -= sy;
 
-            if (sy == src_h - 1 || sx == src_w - 1)
+            if (!inside && (sx < 0 || sy < 0 || sx >= src_w - 1 || sy >= src_h - 1)) {
+                ofs[x] = -1;
+                wx[2 * x] = wx[2 * x + 1] = 0;
+                wy[2 * x] = wy[2 * x + 1] = 0;
                 continue;
-            for (int c = 0; c < 3; c++)
+            }
+            ofs[x] = sy * stride + sx * 3;
+            wx[2 * x] = (short)((1.f - fx) * 2048);
+            wx[2 * x + 1] = 2048 - wx[2 * x];
+            wy[2 * x] = (short)((1.f - fy) * 2048);
+            wy[2 * x + 1] = 2048 - wy[2 * x];
+        }
+
+        // 預設輸出通道 c 取自來源位元組 c (BGR)；swap_rb 時取 2-c，直接得到 RGB
+        for (int c = 0; c < 3; c++)
+        {
+            int sc = swap_rb ? 2 - c : c;
+            for (int x = 0; x < dst_w; x++)
             {
-                dst_u[3 * (y * dst_w + x) + c] = 
-                    (
-                        src_u[3 * (sy * src_w + sx) + c] * cbufx[0] * cbufy[0] +
-                        src_u[3 * ((sy + 1) * src_w + sx) + c] * cbufx[0] * cbufy[1] + 
-                        src_u[3 * (sy * src_w + sx + 1) + c] * cbufx[1] * cbufy[0] +
-                        src_u[3 * ((sy + 1) * src_w + sx + 1) + c] * cbufx[1] * cbufy[1]
-                    ) >> 22;
+                if (ofs[x] < 0) {
+                    row0[2 * x] = row0[2 * x + 1] = row1[2 * x] = row1[2 * x + 1] = 0;
+                    continue;
+                }
+                const unsigned char* p = src + ofs[x] + sc;
+                row0[2 * x] = p[0];
+                row0[2 * x + 1] = p[3];
+                row1[2 * x] = p[stride];
+                row1[2 * x + 1] = p[stride + 3];
             }
+            blendRow(row0, row1, wx, wy, dst.channel(c).row(y), dst_w);
         }
     }
-
-    dst = ncnn::Mat::from_pixels(dst_u, ncnn::Mat::PIXEL_BGR, dst_w, dst_h);
-    delete[] src_u;
-    delete[] dst_u;
 }
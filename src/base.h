@@ -2,8 +2,10 @@
 #define BASE_H
 #include <cmath>
 #include <cstring>
+#include <vector>
 #include <opencv2/opencv.hpp>
 #include "net.h"
+#include "config.h"
 
 typedef struct FaceInfo {
     float score;
@@ -14,16 +16,67 @@ typedef struct FaceInfo {
     int landmark[10];
 } FaceInfo;
 
+// 標準影格表示：8-bit BGR 交錯像素與每列位元組數，直接引用 cv::Mat 的記憶體而不複製。
+// 偵測、追蹤與對齊都讀取這個表示，只有在組成網路輸入時才轉成 float
+struct FrameView {
+    const unsigned char* data = nullptr;
+    int w = 0;
+    int h = 0;
+    int stride = 0;
+
+    FrameView() = default;
+    FrameView(const unsigned char* data, int w, int h, int stride) : data(data), w(w), h(h), stride(stride) {}
+    FrameView(const cv::Mat& img) : data(img.data), w(img.cols), h(img.rows), stride((int)img.step) {}
+
+    bool empty() const { return data == nullptr || w <= 0 || h <= 0; }
+    // 子區域同樣只是位移指標，不複製像素
+    FrameView roi(int x, int y, int roi_w, int roi_h) const { return FrameView(data + y * stride + x * 3, roi_w, roi_h, stride); }
+};
+
+// 裁切 [x0, x1) x [y0, y1) (超出影像的部分截掉) 並縮放為 w x h 的 float 網路輸入
+ncnn::Mat cropResize(const FrameView& img, int x0, int y0, int x1, int y1, int w, int h);
+
+// 寫入呼叫端持有的 dst，每個候選框共用同一個輸入張量時不再配置
+void cropResize(const FrameView& img, int x0, int y0, int x1, int y1, int w, int h, ncnn::Mat& dst);
+
+// 在 load_param 之前把設定檔中的選項套用到網路
+void applyNetOptions(ncnn::Net& net, const NetOptions& options);
+
+// 人臉框與關鍵點座標分別乘上 sx、sy，換算到另一個解析度
+void scaleFaces(std::vector<FaceInfo>& faces, float sx, float sy);
+
+// 讓 dst 成為 w x h x c 的 float 張量；已是此形狀時沿用原本的緩衝區，重新配置才計入暫存區統計
+void ensureMat(ncnn::Mat& dst, int w, int h, int c = 3);
+
 ncnn::Mat resize(ncnn::Mat src, int w, int h);
 
+// 寫入呼叫端持有的 dst，尺寸不變時不重新配置
+void resize(const ncnn::Mat& src, ncnn::Mat& dst, int w, int h);
+
 ncnn::Mat bgr2rgb(ncnn::Mat src);
 
+void bgr2rgb(const ncnn::Mat& src, ncnn::Mat& dst);
+
 ncnn::Mat rgb2bgr(ncnn::Mat src);
 
 cv::Mat ncnn2cv(ncnn::Mat img);
 
+// 寫入呼叫端持有的緩衝區，尺寸不變時重複使用同一塊記憶體
+void ncnn2cv(const ncnn::Mat& img, cv::Mat& dst);
+
+// 將 data 中大於 thresh 的元素索引依序寫入 indices (容量需 >= size)，回傳個數
+int thresholdIndices(const float* data, int size, float thresh, int* indices);
+
 void getAffineMatrix(float* src_5pts, const float* dst_5pts, float* M);
 
+// 批次求 n 張人臉的相似轉換，src_5pts 每張 10 個值 (x0..x4, y0..y4)，M 每張 6 個值
+void getAffineMatrices(const float* src_5pts, int n, const float* dst_5pts, float* M);
+
 void warpAffineMatrix(ncnn::Mat src, ncnn::Mat &dst, float *M, int dst_w, int dst_h);
 
+// 以共用的 8-bit BGR 影像 (每列 stride 位元組) 為來源直接對齊，只讀取人臉在來源中涵蓋的像素，
+// 成本與整張影像的解析度無關；輸出通道順序與來源相同，swap_rb 時交換 R/B
+void warpAffineMatrix(const unsigned char* src, int src_w, int src_h, int stride, ncnn::Mat& dst, float* M, int dst_w, int dst_h,
+                      bool swap_rb = false);
+
 #endif
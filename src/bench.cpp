@@ -0,0 +1,200 @@
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <opencv2/opencv.hpp>
+#include "cpu.h"
+#include "arcface.h"
+#include "mtcnn.h"
+#include "config.h"
+#include "base.h"
+#include "pool_allocator.h"
+#include "scratch_arena.h"
+#include "roi_mask.h"
+
+struct BenchResult {
+    double detect_ms;   // 每幀偵測平均耗時
+    double detect_p99_ms;   // 偵測耗時的 99 百分位
+    double detect_max_ms;   // 偵測耗時的最大值
+    double embed_ms;    // 每幀對齊與特徵提取平均耗時
+    size_t faces;
+    size_t scratch_allocs;  // 計時迴圈內暫存區向 heap 配置的次數
+    size_t mat_allocs;      // 計時迴圈內影像輔助函式輸出張量重新配置的次數
+    double candidate_allocs;  // 每次 Detect 候選框緩衝區的 heap 配置次數
+    double candidate_kb;      // 每次 Detect 複製 FaceInfo 的量 (KB)
+    DetectorStats detect_stats;
+};
+
+static double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void printUsage() {
+    std::cout << "Face Recognition Benchmark" << std::endl;
+    std::cout << "Usage:" << std::endl;
+    std::cout << "  ./bench [-c config.json] <image_path> [iterations] [--sweep]" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  -c config.json               - Specify config file (default: config.json)" << std::endl;
+    std::cout << "  --sweep                      - Sweep ncnn option combinations for all networks" << std::endl;
+}
+
+// 以目前設定檔的選項建立網路並量測
+static BenchResult runBench(const cv::Mat& img, const std::string& image_path, int iterations)
+{
+    MtcnnDetector detector("");
+    detector.setRoi(RoiMask::forSource(image_path));
+    Arcface arc("");
+
+    FrameView frame(img);
+
+    // 暖機一次，排除首次配置的成本
+    std::vector<FaceInfo> results = detector.Detect(frame);
+    arc.getFeatures(frame, results);
+
+    BenchResult result = {0, 0, 0, 0, results.size(), 0, 0, 0, 0, DetectorStats()};
+    std::vector<double> detect_times;
+    detect_times.reserve(iterations);
+    ScratchStats scratch_before = getScratchStats();
+    detector.resetStats();
+    for (int it = 0; it < iterations; it++) {
+        resetScratchArena();
+        auto start = std::chrono::steady_clock::now();
+        results = detector.Detect(frame);
+        detect_times.push_back(elapsedMs(start));
+        result.detect_ms += detect_times.back();
+
+        start = std::chrono::steady_clock::now();
+        arc.getFeatures(frame, results);
+        result.embed_ms += elapsedMs(start);
+    }
+    ScratchStats scratch_after = getScratchStats();
+    result.scratch_allocs = scratch_after.heap_allocations - scratch_before.heap_allocations;
+    result.mat_allocs = scratch_after.mat_allocations - scratch_before.mat_allocations;
+    result.detect_stats = detector.getStats();
+    result.candidate_allocs = result.detect_stats.allocationsPerCall();
+    result.candidate_kb = result.detect_stats.copiedBytesPerCall() / 1024.0;
+    result.detect_ms /= iterations;
+    std::sort(detect_times.begin(), detect_times.end());
+    result.detect_p99_ms = detect_times[std::min((size_t)(iterations * 0.99), detect_times.size() - 1)];
+    result.detect_max_ms = detect_times.back();
+    result.embed_ms /= iterations;
+    return result;
+}
+
+static void setAllNetOptions(Config& config, const NetOptions& options)
+{
+    config.det1_options = options;
+    config.det2_options = options;
+    config.det3_options = options;
+    config.det4_options = options;
+    config.arcface_options = options;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string config_file = "config.json";
+    std::vector<std::string> args;
+    bool sweep = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-c" && i + 1 < argc) {
+            config_file = argv[++i];
+        } else if (arg == "--sweep") {
+            sweep = true;
+        } else {
+            args.push_back(arg);
+        }
+    }
+    if (args.empty()) {
+        printUsage();
+        return -1;
+    }
+
+    std::string image_path = args[0];
+    int iterations = args.size() > 1 ? std::stoi(args[1]) : 10;
+    if (iterations <= 0) {
+        printUsage();
+        return -1;
+    }
+
+    Config& config = Config::getInstance();
+    if (!config.loadConfig(config_file)) {
+        std::cerr << "Failed to load config file: " << config_file << std::endl;
+        return -1;
+    }
+
+    cv::Mat img = cv::imread(image_path);
+    if (img.empty()) {
+        std::cerr << "Error: Cannot read image " << image_path << std::endl;
+        return -1;
+    }
+
+    std::cout << "Image: " << image_path << " (" << img.cols << "x" << img.rows << "), "
+              << iterations << " iteration(s)" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+
+    if (!sweep) {
+        BenchResult r = runBench(img, image_path, iterations);
+        std::cout << "Faces: " << r.faces << std::endl;
+        std::cout << "Detect: " << r.detect_ms << " ms/frame (p99 " << r.detect_p99_ms
+                  << " ms, max " << r.detect_max_ms << " ms)" << std::endl;
+        std::cout << "Embed:  " << r.embed_ms << " ms/frame" << std::endl;
+
+        AllocatorStats stats = getAllocatorStats();
+        std::cout << "Pool allocators (" << stats.workers << " worker(s)): blob hit rate "
+                  << stats.blobHitRate() * 100 << "% (" << stats.blob_hits << "/" << stats.blob_hits + stats.blob_misses
+                  << "), workspace hit rate " << stats.workspaceHitRate() * 100 << "% (" << stats.workspace_hits
+                  << "/" << stats.workspace_hits + stats.workspace_misses << ")" << std::endl;
+
+        ScratchStats scratch = getScratchStats();
+        std::cout << "Scratch arena (" << scratch.threads << " thread(s)): peak " << scratch.peak / 1024.0
+                  << " KB, capacity " << scratch.capacity / 1024.0 << " KB, heap allocations in timed loop "
+                  << r.scratch_allocs << ", image tensor allocations in timed loop " << r.mat_allocs << std::endl;
+        std::cout << "Detector candidates: " << r.candidate_allocs << " allocation(s)/Detect, "
+                  << r.candidate_kb << " KB copied/Detect, pyramid plans built " << r.detect_stats.plan_builds
+                  << std::endl;
+        std::cout << "Detector caps fired (of " << r.detect_stats.calls << " Detect call(s)): pnet "
+                  << r.detect_stats.pnet_capped << ", rnet " << r.detect_stats.rnet_capped
+                  << ", time budget " << r.detect_stats.budget_exceeded << " (" << r.detect_stats.budget_empty
+                  << " with no faces)" << std::endl;
+        std::cout << "Pnet pyramid levels: " << r.detect_stats.pnet_levels << " run, "
+                  << r.detect_stats.pnet_levels_skipped << " skipped by the adaptive size band" << std::endl;
+        std::cout << "ROI: " << r.detect_stats.roi_rejected << " candidate(s) outside the mask dropped before Rnet"
+                  << std::endl;
+        return 0;
+    }
+
+    // 對所有網路套用同一組選項，逐一比較各組合
+    std::vector<int> thread_counts = {1};
+    if (ncnn::get_big_cpu_count() > 1)
+        thread_counts.push_back(ncnn::get_big_cpu_count());
+
+    std::cout << "threads packing fp16 winograd sgemm light | detect_ms embed_ms" << std::endl;
+    for (int threads : thread_counts)
+    for (int packing = 0; packing < 2; packing++)
+    for (int fp16 = 0; fp16 < 2; fp16++)
+    for (int winograd = 0; winograd < 2; winograd++)
+    for (int sgemm = 0; sgemm < 2; sgemm++)
+    for (int light = 0; light < 2; light++) {
+        NetOptions options;
+        options.num_threads = threads;
+        options.use_packing_layout = packing;
+        options.use_fp16_packed = fp16;
+        options.use_fp16_storage = fp16;
+        options.use_fp16_arithmetic = fp16;
+        options.use_winograd_convolution = winograd;
+        options.use_sgemm_convolution = sgemm;
+        options.lightmode = light;
+        setAllNetOptions(config, options);
+
+        BenchResult r = runBench(img, image_path, iterations);
+        std::cout << std::setw(7) << threads << std::setw(8) << packing << std::setw(5) << fp16
+                  << std::setw(9) << winograd << std::setw(6) << sgemm << std::setw(6) << light
+                  << " | " << std::setw(9) << r.detect_ms << std::setw(9) << r.embed_ms << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,627 @@
+#include <vector>
+#include <map>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <opencv2/opencv.hpp>
+#include "arcface.h"
+#include "mtcnn.h"
+#include "face_database.h"
+#include "config.h"
+#include "base.h"
+
+// 每個網路最多保留的校正輸入數
+static const size_t max_samples = 500;
+
+static const int num_histogram_bins = 2048;
+static const int target_bin = 128;
+
+// .param 中的一層
+struct LayerDesc {
+    std::string type;
+    std::string name;
+    std::vector<std::string> bottoms;
+    std::map<int, std::string> params;
+
+    int geti(int id, int def) const
+    {
+        auto it = params.find(id);
+        return it == params.end() ? def : std::stoi(it->second);
+    }
+};
+
+// 需要量化的層 (Convolution / ConvolutionDepthWise / InnerProduct)
+struct QuantLayer {
+    std::string name;
+    std::string bottom;
+    std::vector<float> weight_scales;
+
+    float absmax = 0.f;
+    std::vector<float> histogram;
+    float blob_scale = 1.f;
+};
+
+struct NetCalibration {
+    std::string param_path;
+    std::string bin_path;
+    std::string table_name;
+    std::vector<ncnn::Mat> samples;
+};
+
+void printUsage() {
+    std::cout << "Int8 Calibration Tool" << std::endl;
+    std::cout << "Usage:" << std::endl;
+    std::cout << "  ./calibrate [-c config.json] <command> [args...]" << std::endl;
+    std::cout << "Commands:" << std::endl;
+    std::cout << "  table <output_dir> [image_dir...]  - Compute per-layer int8 scales (features/ is always used)" << std::endl;
+    std::cout << "  compare [image_dir...]             - Report int8 accuracy delta against fp32" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  -c config.json                     - Specify config file (default: config.json)" << std::endl;
+}
+
+static bool isQuantLayer(const std::string& type)
+{
+    return type == "Convolution" || type == "ConvolutionDepthWise" || type == "InnerProduct";
+}
+
+static bool parseParam(const std::string& path, std::vector<LayerDesc>& layers)
+{
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Error: Cannot open param file: " << path << std::endl;
+        return false;
+    }
+
+    int magic = 0, layer_count = 0, blob_count = 0;
+    file >> magic >> layer_count >> blob_count;
+    if (magic != 7767517) {
+        std::cerr << "Error: Unsupported param format: " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    std::getline(file, line);
+    while (std::getline(file, line)) {
+        std::stringstream ss(line);
+        LayerDesc layer;
+        int bottom_count = 0, top_count = 0;
+        if (!(ss >> layer.type >> layer.name >> bottom_count >> top_count))
+            continue;
+        for (int i = 0; i < bottom_count; i++) {
+            std::string bottom;
+            ss >> bottom;
+            layer.bottoms.push_back(bottom);
+        }
+        for (int i = 0; i < top_count; i++) {
+            std::string top;
+            ss >> top;
+        }
+        std::string token;
+        while (ss >> token) {
+            size_t eq = token.find('=');
+            if (eq == std::string::npos)
+                continue;
+            layer.params[std::stoi(token.substr(0, eq))] = token.substr(eq + 1);
+        }
+        layers.push_back(layer);
+    }
+    return (int)layers.size() == layer_count;
+}
+
+static float halfToFloat(unsigned short value)
+{
+    unsigned int sign = (value & 0x8000) << 16;
+    unsigned int exponent = (value >> 10) & 0x1f;
+    unsigned int mantissa = value & 0x3ff;
+    unsigned int bits;
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        } else {
+            // 非正規數
+            exponent = 127 - 15 + 1;
+            while (!(mantissa & 0x400)) {
+                mantissa <<= 1;
+                exponent--;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+        }
+    } else if (exponent == 0x1f) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// 讀取 ModelBin 中帶旗標的權重 (fp32 或 fp16)
+static bool readTagged(FILE* fp, size_t count, std::vector<float>& data)
+{
+    unsigned int tag = 0;
+    if (fread(&tag, sizeof(tag), 1, fp) != 1)
+        return false;
+
+    data.resize(count);
+    if (tag == 0)
+        return fread(data.data(), sizeof(float), count, fp) == count;
+
+    if (tag == 0x01306B47) {
+        std::vector<unsigned short> half((count * 2 + 3) / 4 * 2);
+        if (fread(half.data(), sizeof(unsigned short), half.size(), fp) != half.size())
+            return false;
+        for (size_t i = 0; i < count; i++)
+            data[i] = halfToFloat(half[i]);
+        return true;
+    }
+    return false;
+}
+
+static bool skipFloats(FILE* fp, long count)
+{
+    return fseek(fp, count * (long)sizeof(float), SEEK_CUR) == 0;
+}
+
+// 依 .param 的層順序走過 .bin，計算每個輸出通道 (depthwise 為每組) 的權重 scale
+static bool computeWeightScales(const NetCalibration& net, const std::vector<LayerDesc>& layers,
+                                std::vector<QuantLayer>& quant_layers)
+{
+    FILE* fp = fopen(net.bin_path.c_str(), "rb");
+    if (!fp) {
+        std::cerr << "Error: Cannot open model file: " << net.bin_path << std::endl;
+        return false;
+    }
+
+    bool ok = true;
+    for (auto it = layers.begin(); it != layers.end() && ok; it++) {
+        const LayerDesc& layer = *it;
+        if (isQuantLayer(layer.type)) {
+            if (layer.geti(8, 0) != 0) {
+                std::cerr << "Error: " << net.param_path << " is already quantized" << std::endl;
+                ok = false;
+                break;
+            }
+            int num_output = layer.geti(0, 0);
+            int weight_data_size = layer.geti(layer.type == "InnerProduct" ? 2 : 6, 0);
+            int groups = layer.type == "ConvolutionDepthWise" ? layer.geti(7, 1) : num_output;
+
+            std::vector<float> weight;
+            if (!readTagged(fp, weight_data_size, weight)) {
+                std::cerr << "Error: Unsupported weight storage in " << layer.name << std::endl;
+                ok = false;
+                break;
+            }
+            if (layer.geti(layer.type == "InnerProduct" ? 1 : 5, 0))
+                ok = skipFloats(fp, num_output);
+
+            QuantLayer q;
+            q.name = layer.name;
+            q.bottom = layer.bottoms.empty() ? "" : layer.bottoms[0];
+            int per_group = groups > 0 ? weight_data_size / groups : 0;
+            for (int g = 0; g < groups; g++) {
+                float absmax = 0.f;
+                for (int k = 0; k < per_group; k++)
+                    absmax = std::max(absmax, std::fabs(weight[g * per_group + k]));
+                q.weight_scales.push_back(absmax == 0.f ? 1.f : 127.f / absmax);
+            }
+            quant_layers.push_back(q);
+        } else if (layer.type == "PReLU") {
+            ok = skipFloats(fp, layer.geti(0, 0));
+        } else if (layer.type == "BatchNorm") {
+            ok = skipFloats(fp, 4L * layer.geti(0, 0));
+        } else if (layer.type == "Scale") {
+            int scale_data_size = layer.geti(0, 0);
+            if (scale_data_size != -233)
+                ok = skipFloats(fp, scale_data_size);
+            if (ok && layer.geti(1, 0))
+                ok = skipFloats(fp, scale_data_size == -233 ? 0 : scale_data_size);
+        } else if (layer.type == "Deconvolution" || layer.type == "DeconvolutionDepthWise" ||
+                   layer.type == "Embed" || layer.type == "MemoryData" || layer.type == "Bias") {
+            std::cerr << "Error: Unsupported layer type " << layer.type << " in " << net.param_path << std::endl;
+            ok = false;
+        }
+    }
+
+    // 所有權重都應剛好讀完，否則代表層的配置與預期不符
+    if (ok) {
+        long pos = ftell(fp);
+        fseek(fp, 0, SEEK_END);
+        if (ftell(fp) != pos) {
+            std::cerr << "Error: Weight layout mismatch in " << net.bin_path << std::endl;
+            ok = false;
+        }
+    }
+    fclose(fp);
+    return ok;
+}
+
+static float klDivergence(const std::vector<float>& a, const std::vector<float>& b)
+{
+    float sum_a = 0.f, sum_b = 0.f;
+    for (size_t i = 0; i < a.size(); i++) {
+        sum_a += a[i];
+        sum_b += b[i];
+    }
+    float result = 0.f;
+    for (size_t i = 0; i < a.size(); i++) {
+        float p = a[i] / sum_a;
+        float q = b[i] / sum_b;
+        if (p == 0.f)
+            continue;
+        if (q == 0.f)
+            result += 1.f;
+        else
+            result += p * log(p / q);
+    }
+    return result;
+}
+
+// 以 KL 散度在直方圖上尋找最佳截斷點，回傳截斷的 bin 索引
+static int klThreshold(const std::vector<float>& distribution)
+{
+    const int length = (int)distribution.size();
+    int best = length - 1;
+    float best_kl = INFINITY;
+
+    for (int threshold = target_bin; threshold < length; threshold++) {
+        std::vector<float> clip(distribution.begin(), distribution.begin() + threshold);
+        for (int i = threshold; i < length; i++)
+            clip[threshold - 1] += distribution[i];
+
+        // Q 由未截斷的分佈量化而來，截斷造成的誤差才會反映在 KL 上
+        const float num_per_bin = (float)threshold / target_bin;
+
+        std::vector<float> quantized(target_bin, 0.f);
+        for (int i = 0; i < target_bin; i++) {
+            const float start = i * num_per_bin;
+            const float end = start + num_per_bin;
+            const int left_upper = (int)ceil(start);
+            if (left_upper > start)
+                quantized[i] += (left_upper - start) * distribution[left_upper - 1];
+            const int right_lower = (int)floor(end);
+            if (right_lower < end)
+                quantized[i] += (end - right_lower) * distribution[right_lower];
+            for (int j = left_upper; j < right_lower; j++)
+                quantized[i] += distribution[j];
+        }
+
+        std::vector<float> expanded(threshold, 0.f);
+        for (int i = 0; i < target_bin; i++) {
+            const float start = i * num_per_bin;
+            const float end = start + num_per_bin;
+            const int left_upper = (int)ceil(start);
+            const int right_lower = (int)floor(end);
+            const float left_scale = left_upper > start ? left_upper - start : 0.f;
+            const float right_scale = right_lower < end ? end - right_lower : 0.f;
+
+            float count = 0.f;
+            if (left_scale > 0.f && distribution[left_upper - 1] != 0.f)
+                count += left_scale;
+            if (right_scale > 0.f && distribution[right_lower] != 0.f)
+                count += right_scale;
+            for (int j = left_upper; j < right_lower; j++)
+                if (distribution[j] != 0.f)
+                    count += 1.f;
+            if (count == 0.f)
+                continue;
+
+            const float value = quantized[i] / count;
+            if (left_scale > 0.f && distribution[left_upper - 1] != 0.f)
+                expanded[left_upper - 1] += value * left_scale;
+            if (right_scale > 0.f && distribution[right_lower] != 0.f)
+                expanded[right_lower] += value * right_scale;
+            for (int j = left_upper; j < right_lower; j++)
+                if (distribution[j] != 0.f)
+                    expanded[j] += value;
+        }
+
+        float kl = klDivergence(clip, expanded);
+        if (kl < best_kl) {
+            best_kl = kl;
+            best = threshold;
+        }
+    }
+    return best;
+}
+
+// 對每個量化層的輸入 blob 統計分佈：第一輪取絕對值最大值，第二輪建立直方圖
+static void computeBlobScales(const NetCalibration& net, std::vector<QuantLayer>& quant_layers)
+{
+    ncnn::Net model;
+    model.opt.use_fp16_packed = false;
+    model.opt.use_fp16_storage = false;
+    model.opt.use_fp16_arithmetic = false;
+    model.load_param(net.param_path.c_str());
+    model.load_model(net.bin_path.c_str());
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (auto sample = net.samples.begin(); sample != net.samples.end(); sample++) {
+            ncnn::Extractor ex = model.create_extractor();
+            ex.set_light_mode(false);
+            ex.input("data", *sample);
+
+            for (auto q = quant_layers.begin(); q != quant_layers.end(); q++) {
+                ncnn::Mat blob;
+                ex.extract(q->bottom.c_str(), blob);
+                int size = blob.w * blob.h;
+                for (int c = 0; c < blob.c; c++) {
+                    const float* ptr = blob.channel(c);
+                    if (pass == 0) {
+                        for (int i = 0; i < size; i++)
+                            q->absmax = std::max(q->absmax, std::fabs(ptr[i]));
+                    } else if (q->absmax > 0.f) {
+                        float bin_scale = num_histogram_bins / q->absmax;
+                        for (int i = 0; i < size; i++) {
+                            if (ptr[i] == 0.f)
+                                continue;
+                            int bin = std::min((int)(std::fabs(ptr[i]) * bin_scale), num_histogram_bins - 1);
+                            q->histogram[bin] += 1.f;
+                        }
+                    }
+                }
+            }
+        }
+
+        if (pass == 0)
+            for (auto q = quant_layers.begin(); q != quant_layers.end(); q++)
+                q->histogram.assign(num_histogram_bins, 0.f);
+    }
+
+    for (auto q = quant_layers.begin(); q != quant_layers.end(); q++) {
+        if (q->absmax == 0.f) {
+            q->blob_scale = 1.f;
+            continue;
+        }
+        int threshold_bin = klThreshold(q->histogram);
+        float threshold = (threshold_bin + 0.5f) * q->absmax / num_histogram_bins;
+        q->blob_scale = 127.f / threshold;
+    }
+}
+
+// 輸出 ncnn2int8 可讀的 table 檔
+static bool writeTable(const std::string& path, const std::vector<QuantLayer>& quant_layers)
+{
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Error: Cannot open file for writing: " << path << std::endl;
+        return false;
+    }
+    for (auto q = quant_layers.begin(); q != quant_layers.end(); q++) {
+        file << q->name << "_param_0";
+        for (float s : q->weight_scales)
+            file << " " << s;
+        file << std::endl;
+    }
+    for (auto q = quant_layers.begin(); q != quant_layers.end(); q++)
+        file << q->name << " " << q->blob_scale << std::endl;
+    return true;
+}
+
+static std::vector<cv::String> listImages(const std::vector<std::string>& dirs)
+{
+    std::vector<cv::String> images;
+    for (auto dir = dirs.begin(); dir != dirs.end(); dir++) {
+        std::vector<cv::String> files;
+        cv::glob(*dir, files, true);
+        images.insert(images.end(), files.begin(), files.end());
+    }
+    return images;
+}
+
+static std::string tableName(const std::string& param_file)
+{
+    size_t slash = param_file.find_last_of('/');
+    std::string name = slash == std::string::npos ? param_file : param_file.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+    return (dot == std::string::npos ? name : name.substr(0, dot)) + ".table";
+}
+
+static int runTable(const std::string& output_dir, const std::vector<std::string>& dirs)
+{
+    Config& config = Config::getInstance();
+    config.models_int8 = false;
+
+    NetCalibration nets[5];
+    const std::string params[5] = {config.mtcnn_det1_param, config.mtcnn_det2_param, config.mtcnn_det3_param,
+                                   config.mtcnn_det4_param, config.arcface_param};
+    const std::string bins[5] = {config.mtcnn_det1_bin, config.mtcnn_det2_bin, config.mtcnn_det3_bin,
+                                 config.mtcnn_det4_bin, config.arcface_bin};
+    for (int i = 0; i < 5; i++) {
+        nets[i].param_path = config.getModelPath(params[i]);
+        nets[i].bin_path = config.getModelPath(bins[i]);
+        nets[i].table_name = tableName(params[i]);
+    }
+
+    // 跑一次完整辨識流程，收集每個網路實際看到的輸入
+    MtcnnDetector detector("");
+    Arcface arc("");
+    detector.input_observer = [&nets](int index, const ncnn::Mat& in) {
+        if (nets[index].samples.size() < max_samples)
+            nets[index].samples.push_back(in.clone());
+    };
+    arc.input_observer = [&nets](const ncnn::Mat& in) {
+        if (nets[4].samples.size() < max_samples)
+            nets[4].samples.push_back(in.clone());
+    };
+
+    std::vector<cv::String> images = listImages(dirs);
+    int used = 0;
+    ncnn::Mat face;
+    for (auto path = images.begin(); path != images.end(); path++) {
+        cv::Mat img = cv::imread(*path);
+        if (img.empty())
+            continue;
+        FrameView frame(img);
+        std::vector<FaceInfo> results = detector.Detect(frame);
+        for (size_t i = 0; i < results.size(); i++) {
+            preprocess(frame, results[i], face);
+            arc.getFeature(face);
+        }
+        used++;
+    }
+    std::cout << "Calibration images: " << used << std::endl;
+
+    for (int i = 0; i < 5; i++) {
+        if (nets[i].samples.empty()) {
+            std::cerr << "Warning: No calibration input for " << nets[i].param_path << ", skipped" << std::endl;
+            continue;
+        }
+
+        std::vector<LayerDesc> layers;
+        std::vector<QuantLayer> quant_layers;
+        if (!parseParam(nets[i].param_path, layers) || !computeWeightScales(nets[i], layers, quant_layers))
+            return -1;
+        computeBlobScales(nets[i], quant_layers);
+
+        std::string table_path = output_dir + "/" + nets[i].table_name;
+        if (!writeTable(table_path, quant_layers))
+            return -1;
+        std::cout << nets[i].param_path << ": " << quant_layers.size() << " layer(s), "
+                  << nets[i].samples.size() << " sample(s) -> " << table_path << std::endl;
+    }
+    return 0;
+}
+
+static float iou(const FaceInfo& a, const FaceInfo& b)
+{
+    int w = std::min(a.x[1], b.x[1]) - std::max(a.x[0], b.x[0]) + 1;
+    int h = std::min(a.y[1], b.y[1]) - std::max(a.y[0], b.y[0]) + 1;
+    if (w <= 0 || h <= 0)
+        return 0.f;
+    float inter = (float)w * h;
+    float area_a = (float)(a.x[1] - a.x[0] + 1) * (a.y[1] - a.y[0] + 1);
+    float area_b = (float)(b.x[1] - b.x[0] + 1) * (b.y[1] - b.y[0] + 1);
+    return inter / (area_a + area_b - inter);
+}
+
+static int runCompare(const std::vector<std::string>& dirs)
+{
+    Config& config = Config::getInstance();
+
+    const std::string int8_files[5] = {config.mtcnn_det1_param, config.mtcnn_det2_param, config.mtcnn_det3_param,
+                                       config.mtcnn_det4_param, config.arcface_param};
+    for (int i = 0; i < 5; i++) {
+        std::string path = config.getModelPath(config.getInt8Name(int8_files[i]));
+        if (!std::ifstream(path).good()) {
+            std::cerr << "Error: Int8 model not found: " << path << std::endl;
+            return -1;
+        }
+    }
+
+    config.models_int8 = false;
+    MtcnnDetector detector_fp32("");
+    Arcface arc_fp32("");
+    config.models_int8 = true;
+    MtcnnDetector detector_int8("");
+    Arcface arc_int8("");
+    config.models_int8 = false;
+
+    FaceDatabase db(config.getDatabasePath("face_database.txt"));
+    float threshold = config.face_similarity_threshold;
+
+    int images_used = 0;
+    int faces_fp32 = 0, faces_int8 = 0, faces_matched = 0;
+    int identities = 0, identities_agree = 0;
+    double drift_sum = 0, drift_max = 0, sim_delta_sum = 0;
+
+    std::vector<cv::String> images = listImages(dirs);
+    for (auto path = images.begin(); path != images.end(); path++) {
+        cv::Mat img = cv::imread(*path);
+        if (img.empty())
+            continue;
+        images_used++;
+        FrameView frame(img);
+
+        std::vector<FaceInfo> results_fp32 = detector_fp32.Detect(frame);
+        std::vector<FaceInfo> results_int8 = detector_int8.Detect(frame);
+        faces_fp32 += results_fp32.size();
+        faces_int8 += results_int8.size();
+        for (auto a = results_fp32.begin(); a != results_fp32.end(); a++)
+            for (auto b = results_int8.begin(); b != results_int8.end(); b++)
+                if (iou(*a, *b) > 0.5f) {
+                    faces_matched++;
+                    break;
+                }
+
+        // 以 fp32 的對齊結果比較兩種精度的特徵，單獨衡量 ArcFace 的量化誤差
+        for (size_t i = 0; i < results_fp32.size(); i++) {
+            ncnn::Mat face = preprocess(frame, results_fp32[i]);
+            std::vector<float> feature_fp32 = arc_fp32.getFeature(face);
+            std::vector<float> feature_int8 = arc_int8.getFeature(face);
+
+            double drift = 1.0 - calcSimilar(feature_fp32, feature_int8);
+            drift_sum += drift;
+            drift_max = std::max(drift_max, drift);
+
+            if (db.size() > 0) {
+                auto match_fp32 = db.searchPerson(feature_fp32, threshold);
+                auto match_int8 = db.searchPerson(feature_int8, threshold);
+                identities++;
+                identities_agree += match_fp32.first == match_int8.first;
+                sim_delta_sum += std::fabs(match_fp32.second - match_int8.second);
+            }
+        }
+    }
+
+    std::cout << std::fixed << std::setprecision(4);
+    std::cout << "Images: " << images_used << std::endl;
+    std::cout << "Detection: fp32 " << faces_fp32 << " face(s), int8 " << faces_int8 << " face(s), "
+              << faces_matched << " matched (IoU > 0.5)" << std::endl;
+    if (faces_fp32 > 0) {
+        std::cout << "Embedding drift (1 - cos): mean " << drift_sum / faces_fp32 << ", max " << drift_max << std::endl;
+    }
+    if (identities > 0) {
+        std::cout << "Top-1 identity agreement: " << identities_agree << "/" << identities << " ("
+                  << 100.0 * identities_agree / identities << "%)" << std::endl;
+        std::cout << "Mean best-match similarity delta: " << sim_delta_sum / identities << std::endl;
+    } else {
+        std::cout << "Top-1 identity agreement: skipped (empty database)" << std::endl;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        printUsage();
+        return -1;
+    }
+
+    std::string config_file = "config.json";
+    int arg_start = 1;
+    if (argc >= 3 && std::string(argv[1]) == "-c") {
+        if (argc < 4) {
+            printUsage();
+            return -1;
+        }
+        config_file = argv[2];
+        arg_start = 3;
+    }
+
+    std::string command = argv[arg_start];
+
+    Config& config = Config::getInstance();
+    if (!config.loadConfig(config_file)) {
+        std::cerr << "Failed to load config file: " << config_file << std::endl;
+        return -1;
+    }
+
+    if (command == "table" && argc >= arg_start + 2) {
+        std::vector<std::string> dirs = {config.features_path};
+        for (int i = arg_start + 2; i < argc; i++)
+            dirs.push_back(argv[i]);
+        return runTable(argv[arg_start + 1], dirs);
+    } else if (command == "compare") {
+        std::vector<std::string> dirs = {config.features_path};
+        for (int i = arg_start + 1; i < argc; i++)
+            dirs.push_back(argv[i]);
+        return runCompare(dirs);
+    }
+
+    printUsage();
+    return -1;
+}
@@ -1,11 +1,50 @@
 #include "config.h"
 #include <fstream>
+#include <stdexcept>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <json/json.hpp>
 
 using json = nlohmann::json;
 
+// 讀取 ncnn 選項區塊，只覆寫有出現的欄位
+static void parseNetOptions(const json& j, NetOptions& options) {
+    if (j.contains("num_threads")) options.num_threads = j["num_threads"].get<int>();
+    if (j.contains("lightmode")) options.lightmode = j["lightmode"].get<bool>();
+    if (j.contains("use_packing_layout")) options.use_packing_layout = j["use_packing_layout"].get<bool>();
+    if (j.contains("use_fp16_packed")) options.use_fp16_packed = j["use_fp16_packed"].get<bool>();
+    if (j.contains("use_fp16_storage")) options.use_fp16_storage = j["use_fp16_storage"].get<bool>();
+    if (j.contains("use_fp16_arithmetic")) options.use_fp16_arithmetic = j["use_fp16_arithmetic"].get<bool>();
+    if (j.contains("use_winograd_convolution")) options.use_winograd_convolution = j["use_winograd_convolution"].get<bool>();
+    if (j.contains("use_sgemm_convolution")) options.use_sgemm_convolution = j["use_sgemm_convolution"].get<bool>();
+}
+
+// 讀取一個來源的偵測區域：{"rect": [x, y, w, h]} 轉成四邊形，{"polygon": [[x, y], ...]} 直接攤平，
+// 其他型別提出警告後略過
+static std::vector<RoiPolygon> parseRoiRegions(const std::string& source, const json& j) {
+    std::vector<RoiPolygon> polygons;
+    for (const json& region : j) {
+        RoiPolygon poly;
+        if (region.contains("rect")) {
+            std::vector<float> r = region["rect"].get<std::vector<float> >();
+            if (r.size() != 4)
+                throw std::runtime_error("roi rect must be [x, y, w, h]");
+            poly = {r[0], r[1], r[0] + r[2], r[1], r[0] + r[2], r[1] + r[3], r[0], r[1] + r[3]};
+        } else if (region.contains("polygon")) {
+            for (const json& pt : region["polygon"]) {
+                poly.push_back(pt.at(0).get<float>());
+                poly.push_back(pt.at(1).get<float>());
+            }
+        } else {
+            std::cerr << "Warning: Ignoring roi region of " << source << " without rect or polygon: "
+                      << region.dump() << std::endl;
+            continue;
+        }
+        polygons.push_back(poly);
+    }
+    return polygons;
+}
+
 Config& Config::getInstance() {
     static Config instance;
     return instance;
@@ -39,6 +78,11 @@ bool Config::loadConfig(const std::string& config_file) {
         arcface_param = j["models"]["arcface"]["param"];
         arcface_bin = j["models"]["arcface"]["bin"];
         
+        // 解析 int8 模型設定 (選填)
+        models_int8 = j["models"].value("int8", models_int8);
+        int8_suffix = j["models"].value("int8_suffix", int8_suffix);
+        models_bundle = j["models"].value("bundle", models_bundle);
+        
         // 解析路徑設定
         images_path = j["paths"]["images"];
         results_path = j["paths"]["results"];
@@ -54,6 +98,90 @@ bool Config::loadConfig(const std::string& config_file) {
         save_detected_faces = j["settings"]["save_detected_faces"];
         save_detection_boxes = j["settings"]["save_detection_boxes"];
         
+        // 解析偵測器設定 (選填)
+        if (j.contains("detector")) {
+            const json& d = j["detector"];
+            nms_grid = d.value("nms_grid", nms_grid);
+            max_pnet_candidates = d.value("max_pnet_candidates", max_pnet_candidates);
+            max_rnet_candidates = d.value("max_rnet_candidates", max_rnet_candidates);
+            time_budget_ms = d.value("time_budget_ms", time_budget_ms);
+            max_face_size = d.value("max_face_size", max_face_size);
+            adaptive_scales = d.value("adaptive_scales", adaptive_scales);
+            detect_scale = d.value("detect_scale", detect_scale);
+            detector_use_lnet = d.value("use_lnet", detector_use_lnet);
+            adaptive_margin = d.value("adaptive_margin", adaptive_margin);
+            adaptive_warmup_faces = d.value("adaptive_warmup_faces", adaptive_warmup_faces);
+            adaptive_refresh_interval = d.value("adaptive_refresh_interval", adaptive_refresh_interval);
+        }
+        
+        // 解析追蹤模式設定 (選填)
+        if (j.contains("tracking")) {
+            const json& t = j["tracking"];
+            tracking_keyframe_interval = t.value("keyframe_interval", tracking_keyframe_interval);
+            tracking_margin = t.value("margin", tracking_margin);
+            tracking_min_confidence = t.value("min_confidence", tracking_min_confidence);
+            tracking_use_lnet = t.value("use_lnet", tracking_use_lnet);
+        }
+        
+        // 解析變動偵測設定 (選填)
+        if (j.contains("motion")) {
+            const json& m = j["motion"];
+            motion_enabled = m.value("enabled", motion_enabled);
+            motion_width = m.value("width", motion_width);
+            motion_pixel_threshold = m.value("pixel_threshold", motion_pixel_threshold);
+            motion_min_cell_pixels = m.value("min_cell_pixels", motion_min_cell_pixels);
+            motion_margin = m.value("margin", motion_margin);
+            motion_max_idle_frames = m.value("max_idle_frames", motion_max_idle_frames);
+        }
+        
+        // 解析註冊設定 (選填)
+        if (j.contains("enrollment")) {
+            const json& e = j["enrollment"];
+            enroll_largest_face = e.value("largest_face", enroll_largest_face);
+            enroll_min_face_size = e.value("min_face_size", enroll_min_face_size);
+            enroll_min_confidence = e.value("min_confidence", enroll_min_confidence);
+        }
+        
+        // 解析分塊偵測設定 (選填)
+        if (j.contains("tiling")) {
+            const json& t = j["tiling"];
+            tiling_enabled = t.value("enabled", tiling_enabled);
+            tiling_tile_size = t.value("tile_size", tiling_tile_size);
+            tiling_max_face_size = t.value("max_face_size", tiling_max_face_size);
+            tiling_threads = t.value("threads", tiling_threads);
+        }
+        
+        // 解析影像讀取設定 (選填)
+        if (j.contains("ingest")) {
+            const json& t = j["ingest"];
+            ingest_reduced_decode = t.value("reduced_decode", ingest_reduced_decode);
+            ingest_min_face_size = t.value("min_face_size", ingest_min_face_size);
+        }
+        
+        // 解析各網路的 ncnn 選項 (選填)，default 先套用到全部網路
+        if (j.contains("ncnn")) {
+            const json& n = j["ncnn"];
+            NetOptions* targets[] = {&det1_options, &det2_options, &det3_options, &det4_options, &arcface_options};
+            const char* names[] = {"det1", "det2", "det3", "det4", "arcface"};
+            for (int i = 0; i < 5; i++) {
+                if (n.contains("default")) parseNetOptions(n["default"], *targets[i]);
+                if (n.contains(names[i])) parseNetOptions(n[names[i]], *targets[i]);
+            }
+        }
+        
+        // 解析各輸入來源的偵測區域 (選填)
+        if (j.contains("roi")) {
+            roi_sources.clear();
+            for (auto it = j["roi"].begin(); it != j["roi"].end(); it++) {
+                // 空字串會被當成所有路徑的前綴，不接受
+                if (it.key().empty()) {
+                    std::cerr << "Warning: Ignoring roi entry with an empty source key" << std::endl;
+                    continue;
+                }
+                roi_sources[it.key()] = parseRoiRegions(it.key(), it.value());
+            }
+        }
+        
         // 如果設定為自動創建目錄，則創建所需目錄
         if (create_directories) {
             createDirectories();
@@ -81,6 +209,19 @@ std::string Config::getModelPath(const std::string& relative_path) const {
     return joinPath(models_base_path, relative_path);
 }
 
+std::string Config::getNetModelPath(const std::string& relative_path) const {
+    return getModelPath(models_int8 ? getInt8Name(relative_path) : relative_path);
+}
+
+std::string Config::getInt8Name(const std::string& filename) const {
+    size_t dot = filename.find_last_of('.');
+    size_t slash = filename.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return filename + int8_suffix;
+    }
+    return filename.substr(0, dot) + int8_suffix + filename.substr(dot);
+}
+
 std::string Config::getImagePath(const std::string& filename) const {
     return joinPath(images_path, filename);
 }
@@ -98,6 +239,31 @@ std::string Config::getDatabasePath(const std::string& filename) const {
     return joinPath(database_path, filename);
 }
 
+const std::vector<RoiPolygon>& Config::getRoiPolygons(const std::string& source) const {
+    static const std::vector<RoiPolygon> none;
+    auto exact = roi_sources.find(source);
+    if (exact != roi_sources.end())
+        return exact->second;
+
+    // 以目錄設定整個來源時，影格路徑會以該目錄開頭
+    auto best = roi_sources.end();
+    for (auto it = roi_sources.begin(); it != roi_sources.end(); it++) {
+        const std::string& key = it->first;
+        if (key.empty())
+            continue;
+        bool is_dir_prefix = source.size() > key.size() && source.compare(0, key.size(), key) == 0 &&
+                             (key.back() == '/' || source[key.size()] == '/');
+        if (key != "default" && is_dir_prefix &&
+            (best == roi_sources.end() || key.size() > best->first.size()))
+            best = it;
+    }
+    if (best != roi_sources.end())
+        return best->second;
+
+    auto fallback = roi_sources.find("default");
+    return fallback != roi_sources.end() ? fallback->second : none;
+}
+
 bool Config::directoryExists(const std::string& path) const {
     struct stat info;
     return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
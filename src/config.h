@@ -3,6 +3,24 @@
 
 #include <string>
 #include <iostream>
+#include <optional>
+#include <map>
+#include <vector>
+
+// 單一網路的 ncnn::Option 覆寫值，未設定的欄位沿用 ncnn 預設
+struct NetOptions {
+    std::optional<int> num_threads;
+    std::optional<bool> lightmode;
+    std::optional<bool> use_packing_layout;
+    std::optional<bool> use_fp16_packed;
+    std::optional<bool> use_fp16_storage;
+    std::optional<bool> use_fp16_arithmetic;
+    std::optional<bool> use_winograd_convolution;
+    std::optional<bool> use_sgemm_convolution;
+};
+
+// 偵測區域多邊形，頂點座標為相對於影格寬高的 0~1 比例，依序 x0, y0, x1, y1, ...
+typedef std::vector<float> RoiPolygon;
 
 class Config {
 public:
@@ -13,6 +31,9 @@ public:
     std::string mtcnn_det3_param, mtcnn_det3_bin;
     std::string mtcnn_det4_param, mtcnn_det4_bin;
     std::string arcface_param, arcface_bin;
+    bool models_int8 = false;             // 改用量化後的 int8 模型
+    std::string int8_suffix = "-int8";    // int8 模型檔名後綴，如 det1-int8.param
+    std::string models_bundle;            // 頁對齊的模型包，設定後以 mmap 載入所有網路
     
     // 路徑相關
     std::string images_path;
@@ -30,6 +51,55 @@ public:
     bool save_detected_faces;
     bool save_detection_boxes;
     
+    // 偵測器設定
+    bool nms_grid = true;         // NMS 以網格分桶跳過距離遠的框
+    int max_pnet_candidates = 0;  // Pnet NMS 後最多保留的候選框數，0 表示不限制
+    int max_rnet_candidates = 0;  // Rnet NMS 後最多保留的候選框數，0 表示不限制
+    double time_budget_ms = 0;    // 單幀偵測時間上限，超過即截斷剩餘階段，0 表示不限制
+    int max_face_size = 0;        // 要找的最大人臉邊長，捨棄更粗的金字塔層，0 表示不限制
+    bool adaptive_scales = false; // 依最近偵測到的人臉大小只跑涵蓋該範圍的 Pnet 尺度
+    float detect_scale = 1.0f;    // MTCNN 在縮小成此比例的影格上執行，對齊仍取原解析度
+    bool detector_use_lnet = true; // 完整偵測後是否執行 Lnet 精修關鍵點
+    float adaptive_margin = 1.5f; // 觀察到的尺寸範圍上下放寬的倍率
+    int adaptive_warmup_faces = 20;      // 累積多少張人臉後才開始縮小範圍
+    int adaptive_refresh_interval = 30;  // 每 N 幀做一次完整搜尋，0 表示不做
+    
+    // 追蹤模式設定
+    int tracking_keyframe_interval = 10;   // 每 N 幀執行一次完整偵測
+    float tracking_margin = 0.2f;          // 追蹤框向外擴張比例
+    float tracking_min_confidence = 0.9f;  // 低於此分數即重新完整偵測
+    bool tracking_use_lnet = true;         // 非關鍵幀是否執行 Lnet
+    
+    // 變動偵測設定 (track 模式)
+    bool motion_enabled = false;           // 畫面沒變動時略過偵測，有變動時只偵測變動區塊
+    int motion_width = 160;                // 比較用的灰階影格寬度
+    int motion_pixel_threshold = 20;       // 灰階差超過此值的像素視為變動
+    int motion_min_cell_pixels = 4;        // 8x8 格子內至少這麼多變動像素才算變動
+    float motion_margin = 0.5f;            // 變動區塊向外擴張的比例
+    int motion_max_idle_frames = 100;      // 連續沒有變動這麼多幀後仍完整偵測一次，0 表示不做
+    
+    // 註冊設定
+    bool enroll_largest_face = true;       // 註冊時由粗到細偵測並提前結束
+    int enroll_min_face_size = 80;         // 提前結束所需的最小人臉邊長 (像素)
+    float enroll_min_confidence = 0.95f;   // 提前結束所需的最低分數
+    
+    // 大圖分塊偵測設定
+    bool tiling_enabled = false;           // 圖片超過 tile_size 時分塊平行偵測
+    int tiling_tile_size = 640;            // 區塊邊長 (像素)
+    int tiling_max_face_size = 160;        // 區塊重疊寬度，即可偵測的最大人臉
+    int tiling_threads = 0;                // 平行執行緒數，0 表示使用全部核心
+    
+    // 影像讀取設定
+    bool ingest_reduced_decode = false;    // 大張 JPEG 以 1/2、1/4、1/8 解析度解碼後再偵測
+    int ingest_min_face_size = 80;         // 要找的最小人臉邊長 (原圖像素)，決定可縮小的倍率
+    
+    // 各輸入來源的偵測區域，"default" 套用於沒有個別設定的來源
+    std::map<std::string, std::vector<RoiPolygon> > roi_sources;
+    
+    // 各網路的 ncnn 執行選項
+    NetOptions det1_options, det2_options, det3_options, det4_options;
+    NetOptions arcface_options;
+    
     // 單例模式
     static Config& getInstance();
     
@@ -38,10 +108,14 @@ public:
     
     // 獲取完整路徑的輔助函數
     std::string getModelPath(const std::string& relative_path) const;
+    std::string getNetModelPath(const std::string& relative_path) const;  // 依 models_int8 選擇模型檔
+    std::string getInt8Name(const std::string& filename) const;
     std::string getImagePath(const std::string& filename) const;
     std::string getResultPath(const std::string& filename) const;
     std::string getFeaturePath(const std::string& filename) const;
     std::string getDatabasePath(const std::string& filename) const;
+    // 依來源路徑找偵測區域：完全相同 > 最長的路徑前綴 > "default"
+    const std::vector<RoiPolygon>& getRoiPolygons(const std::string& source) const;
     
     // 創建目錄
     bool createDirectories() const;
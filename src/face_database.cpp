@@ -64,6 +64,29 @@ std::pair<std::string, float> FaceDatabase::searchPerson(const std::vector<float
     return {best_match, best_similarity};
 }
 
+std::vector<std::pair<std::string, float>> FaceDatabase::searchPersons(const float* features, int count,
+                                                                        float threshold) {
+    std::vector<std::pair<std::string, float>> matches(count, {"Unknown", 0.0f});
+    
+    // 外層走訪資料庫，每個人的特徵只讀一次就與所有查詢比對
+    for (const auto& person : database) {
+        if (person.feature.size() != 128) continue;
+        const float* ref = person.feature.data();
+        for (int q = 0; q < count; q++) {
+            const float* feature = features + q * 128;
+            float similarity = 0.0;
+            for (int i = 0; i < 128; i++) {
+                similarity += feature[i] * ref[i];
+            }
+            if (similarity > matches[q].second && similarity >= threshold) {
+                matches[q] = {person.name, similarity};
+            }
+        }
+    }
+    
+    return matches;
+}
+
 std::vector<PersonFeature> FaceDatabase::getAllPersons() {
     return database;
 }
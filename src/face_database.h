@@ -27,6 +27,10 @@ public:
     std::pair<std::string, float> searchPerson(const std::vector<float>& feature, 
                                                 float threshold = 0.6);
     
+    // 一次搜索 count 個連續排列的特徵 (count x 128)，回傳每個特徵的最佳匹配
+    std::vector<std::pair<std::string, float>> searchPersons(const float* features, int count,
+                                                             float threshold = 0.6);
+    
     // 獲取所有人員列表
     std::vector<PersonFeature> getAllPersons();
     
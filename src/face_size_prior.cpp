@@ -0,0 +1,70 @@
+#include "face_size_prior.h"
+#include <cmath>
+#include <algorithm>
+
+FaceSizePrior::FaceSizePrior()
+{
+    reset();
+}
+
+void FaceSizePrior::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int i = 0; i < kBins; i++)
+        bins[i] = 0;
+    total = 0;
+    observed = 0;
+    frames_since_full = 0;
+}
+
+int FaceSizePrior::binOf(float size)
+{
+    int bin = (int)std::floor((std::log2(std::max(size, 1.0f)) - kMinLog2) * kBinsPerOctave);
+    return std::min(std::max(bin, 0), kBins - 1);
+}
+
+float FaceSizePrior::binEdge(int bin)
+{
+    return std::exp2((float)kMinLog2 + (float)bin / kBinsPerOctave);
+}
+
+bool FaceSizePrior::band(float& min_size, float& max_size)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (observed < warmup_faces || total <= 0)
+        return false;
+    if (refresh_interval > 0 && ++frames_since_full >= refresh_interval) {
+        frames_since_full = 0;
+        return false;
+    }
+
+    // 由兩端累加到 (1 - coverage) / 2 為止，得到涵蓋大多數人臉的區間
+    float tail = total * (1.0f - coverage) * 0.5f;
+    int lo = 0;
+    for (float sum = bins[0]; lo < kBins - 1 && sum <= tail; sum += bins[++lo]);
+    int hi = kBins - 1;
+    for (float sum = bins[hi]; hi > 0 && sum <= tail; sum += bins[--hi]);
+
+    min_size = binEdge(lo) / margin;
+    max_size = binEdge(hi + 1) * margin;
+    return true;
+}
+
+void FaceSizePrior::observe(const std::vector<FaceInfo>& faces)
+{
+    if (faces.empty())
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    total = 0;
+    for (int i = 0; i < kBins; i++) {
+        bins[i] *= decay;
+        total += bins[i];
+    }
+    for (auto it = faces.begin(); it != faces.end(); it++) {
+        float w = it->x[1] - it->x[0] + 1;
+        float h = it->y[1] - it->y[0] + 1;
+        bins[binOf(std::max(w, h))] += 1;
+        total += 1;
+    }
+    observed += (int)faces.size();
+}
@@ -0,0 +1,45 @@
+#ifndef FACE_SIZE_PRIOR_H
+#define FACE_SIZE_PRIOR_H
+
+#include <mutex>
+#include <vector>
+#include "base.h"
+
+// 固定安裝的攝影機人臉大小集中在窄範圍內：以對數尺寸直方圖記錄偵測到的人臉邊長，
+// 只搜尋觀察到的範圍 (加上安全邊界)，並定期做一次完整搜尋以發現新的尺寸
+class FaceSizePrior {
+public:
+    FaceSizePrior();
+
+    // 取得本幀要搜尋的人臉邊長範圍；回傳 false 表示資料不足或到了定期完整搜尋，
+    // 本幀應掃描全部尺度
+    bool band(float& min_size, float& max_size);
+
+    // 以本幀偵測結果更新直方圖
+    void observe(const std::vector<FaceInfo>& faces);
+
+    void reset();
+
+    float margin = 1.5f;         // 範圍上下各放寬的倍率
+    int warmup_faces = 20;       // 累積這麼多張人臉後才開始縮小搜尋範圍
+    int refresh_interval = 30;   // 每 N 幀做一次完整搜尋，0 表示不做
+    float decay = 0.99f;         // 每次更新時舊資料的衰減係數，讓分布能跟著場景變化
+    float coverage = 0.98f;      // 範圍需涵蓋的人臉比例，兩端各捨棄一半作為離群值
+
+private:
+    static const int kBinsPerOctave = 4;
+    static const int kMinLog2 = 3;     // 8 像素
+    static const int kMaxLog2 = 13;    // 8192 像素
+    static const int kBins = (kMaxLog2 - kMinLog2) * kBinsPerOctave;
+
+    std::mutex mutex;
+    float bins[kBins];
+    float total;
+    int observed;
+    int frames_since_full;
+
+    static int binOf(float size);
+    static float binEdge(int bin);
+};
+
+#endif // FACE_SIZE_PRIOR_H
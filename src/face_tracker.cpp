@@ -0,0 +1,131 @@
+#include "face_tracker.h"
+#include "config.h"
+
+FaceTracker::FaceTracker(MtcnnDetector& detector)
+    : detector(detector), frames_since_keyframe(0), last_keyframe(false), last_idle(false)
+{
+    Config& config = Config::getInstance();
+
+    this->keyframe_interval = config.tracking_keyframe_interval;
+    this->margin = config.tracking_margin;
+    this->min_confidence = config.tracking_min_confidence;
+    this->use_lnet = config.tracking_use_lnet;
+
+    this->motion_gating = config.motion_enabled;
+    motion.width = config.motion_width;
+    motion.pixel_threshold = config.motion_pixel_threshold;
+    motion.min_cell_pixels = config.motion_min_cell_pixels;
+    motion.margin = config.motion_margin;
+    motion.max_idle_frames = config.motion_max_idle_frames;
+}
+
+FaceTracker::~FaceTracker()
+{
+}
+
+void FaceTracker::reset()
+{
+    tracks.clear();
+    frames_since_keyframe = 0;
+    motion.reset();
+}
+
+std::vector<FaceInfo> FaceTracker::Detect(const FrameView& img)
+{
+    // 與上一個關鍵幀相比沒有變動，偵測結果必然相同，直接沿用
+    last_idle = motion_gating && !motion.update(img);
+    if (last_idle)
+    {
+        last_keyframe = false;
+        return tracks;
+    }
+
+    bool keyframe = frames_since_keyframe == 0 || frames_since_keyframe >= keyframe_interval;
+
+    // 沒有追蹤目標時非關鍵幀沒有東西可以更新，每幀都做關鍵幀，新出現的人臉不必等到下一個關鍵幀；
+    // 閘門要求整幀重新偵測時也立即做關鍵幀
+    if (tracks.empty() || (motion_gating && motion.isFullFrame()))
+        keyframe = true;
+
+    if (!keyframe)
+    {
+        size_t num_tracks = tracks.size();
+        std::vector<FaceInfo> refreshed = detector.Refresh(img, expandTracks(img.w, img.h), use_lnet);
+
+        // 有追蹤框遺失或分數下降時，改在本幀執行完整偵測
+        bool lost = refreshed.size() < num_tracks;
+        for (auto it = refreshed.begin(); it != refreshed.end() && !lost; it++)
+            if (it->score < min_confidence)
+                lost = true;
+
+        if (!lost)
+        {
+            tracks = refreshed;
+            frames_since_keyframe++;
+            last_keyframe = false;
+            return tracks;
+        }
+    }
+
+    tracks = detectKeyframe(img);
+    frames_since_keyframe = 1;
+    last_keyframe = true;
+    return tracks;
+}
+
+std::vector<FaceInfo> FaceTracker::detectKeyframe(const FrameView& img)
+{
+    if (!motion_gating)
+        return detector.Detect(img);
+
+    // 參考幀改為本幀；之後只有相對於本幀的變動才會觸發偵測
+    motion.accept();
+    const std::vector<cv::Rect>& regions = motion.getRegions();
+    if (regions.size() == 1 && regions[0].area() >= img.w * img.h)
+        return detector.Detect(img);
+
+    // 只在變動區塊內偵測；完全落在變動區塊外的追蹤框像素沒變，結果直接保留
+    std::vector<FaceInfo> faces = detector.DetectRegions(img, regions);
+    for (auto it = tracks.begin(); it != tracks.end(); it++)
+    {
+        cv::Rect box(it->x[0], it->y[0], it->x[1] - it->x[0] + 1, it->y[1] - it->y[0] + 1);
+        bool moved = false;
+        for (auto r = regions.begin(); r != regions.end() && !moved; r++)
+            moved = (box & *r).area() > 0;
+        if (!moved)
+            faces.push_back(*it);
+    }
+    return faces;
+}
+
+std::vector<FaceInfo> FaceTracker::expandTracks(int img_w, int img_h) const
+{
+    std::vector<FaceInfo> boxes;
+    boxes.reserve(tracks.size());
+    for (auto it = tracks.begin(); it != tracks.end(); it++)
+    {
+        // 以追蹤框中心取正方形並向外擴張 margin，涵蓋幀間的位移
+        float w = it->x[1] - it->x[0] + 1;
+        float h = it->y[1] - it->y[0] + 1;
+        float m = (h > w ? h : w) * (1.f + 2.f * margin);
+        float cx = it->x[0] + w * 0.5f;
+        float cy = it->y[0] + h * 0.5f;
+
+        FaceInfo box = *it;
+        box.x[0] = (int)round(cx - m * 0.5f);
+        box.y[0] = (int)round(cy - m * 0.5f);
+        box.x[1] = (int)round(cx + m * 0.5f) - 1;
+        box.y[1] = (int)round(cy + m * 0.5f) - 1;
+
+        if (box.x[0] < 0) box.x[0] = 0;
+        if (box.y[0] < 0) box.y[0] = 0;
+        if (box.x[1] > img_w - 1) box.x[1] = img_w - 1;
+        if (box.y[1] > img_h - 1) box.y[1] = img_h - 1;
+        if (box.x[1] <= box.x[0] || box.y[1] <= box.y[0])
+            continue;
+
+        box.area = (box.x[1] - box.x[0]) * (box.y[1] - box.y[0]);
+        boxes.push_back(box);
+    }
+    return boxes;
+}
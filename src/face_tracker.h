@@ -0,0 +1,44 @@
+#ifndef FACE_TRACKER_H
+#define FACE_TRACKER_H
+
+#include <vector>
+#include "net.h"
+#include "base.h"
+#include "mtcnn.h"
+#include "motion_gate.h"
+
+// 影片追蹤模式：關鍵幀執行完整 MTCNN，其餘幀只以 Onet 更新上一幀的追蹤框
+class FaceTracker {
+public:
+    FaceTracker(MtcnnDetector& detector);
+    ~FaceTracker();
+
+    std::vector<FaceInfo> Detect(const FrameView& img);
+
+    // 清除追蹤狀態，下一幀強制執行完整偵測
+    void reset();
+
+    // 最近一次 Detect 是否為關鍵幀
+    bool isKeyframe() const { return last_keyframe; }
+    // 最近一次 Detect 是否因畫面沒有變動而整幀略過，回傳的是上一次的結果
+    bool isIdle() const { return last_idle; }
+
+    int keyframe_interval = 10;   // 每 N 幀執行一次完整偵測
+    float margin = 0.2f;          // 追蹤框向外擴張的比例
+    float min_confidence = 0.9f;  // 追蹤分數低於此值時改做完整偵測
+    bool use_lnet = true;         // 更新時是否執行 Lnet 精修關鍵點
+    bool motion_gating = false;   // 畫面沒變動時略過偵測，有變動時關鍵幀只偵測變動區塊
+    MotionGate motion;
+
+private:
+    MtcnnDetector& detector;
+    std::vector<FaceInfo> tracks;
+    int frames_since_keyframe;
+    bool last_keyframe;
+    bool last_idle;
+
+    std::vector<FaceInfo> expandTracks(int img_w, int img_h) const;
+    std::vector<FaceInfo> detectKeyframe(const FrameView& img);
+};
+
+#endif // FACE_TRACKER_H
@@ -0,0 +1,125 @@
+#include "image_ingest.h"
+#include <fstream>
+#include <algorithm>
+
+bool readJpegSize(const std::string& path, int& w, int& h)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    unsigned char soi[2];
+    if (!file.read((char*)soi, 2) || soi[0] != 0xFF || soi[1] != 0xD8)
+        return false;
+
+    // 逐一跳過區段直到 SOF (C0~CF，排除 DHT=C4、JPG=C8、DAC=CC)
+    while (file) {
+        int c = file.get();
+        if (c != 0xFF)
+            return false;
+        int marker = file.get();
+        while (marker == 0xFF)
+            marker = file.get();
+        if (marker == 0xD9 || marker == 0xDA || marker < 0)
+            return false;
+
+        unsigned char len_bytes[2];
+        if (!file.read((char*)len_bytes, 2))
+            return false;
+        int len = (len_bytes[0] << 8) | len_bytes[1];
+        if (len < 2)
+            return false;
+
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            unsigned char sof[5];
+            if (!file.read((char*)sof, 5))
+                return false;
+            h = (sof[1] << 8) | sof[2];
+            w = (sof[3] << 8) | sof[4];
+            return w > 0 && h > 0;
+        }
+        file.seekg(len - 2, std::ios::cur);
+    }
+    return false;
+}
+
+int chooseReduction(int full_w, int full_h, int min_face_size, int detector_min_size, int align_size)
+{
+    if (min_face_size <= 0 || detector_min_size <= 0)
+        return 1;
+    // 縮小解碼後若還得為對齊重新解碼原圖，總成本比直接解碼原圖還高
+    int face_min = std::max(detector_min_size, align_size);
+    int min_side = std::min(full_w, full_h);
+    for (int r = 8; r > 1; r /= 2) {
+        if (min_face_size / r >= face_min && min_side / r >= detector_min_size)
+            return r;
+    }
+    return 1;
+}
+
+cv::Mat imreadReduced(const std::string& path, int reduction)
+{
+    switch (reduction) {
+    case 2: return cv::imread(path, cv::IMREAD_REDUCED_COLOR_2);
+    case 4: return cv::imread(path, cv::IMREAD_REDUCED_COLOR_4);
+    case 8: return cv::imread(path, cv::IMREAD_REDUCED_COLOR_8);
+    default: return cv::imread(path);
+    }
+}
+
+bool loadForDetection(const std::string& path, int min_face_size, int detector_min_size, IngestImage& out,
+                      int align_size)
+{
+    out.path = path;
+    out.reduction = 1;
+
+    int w = 0, h = 0;
+    if (readJpegSize(path, w, h))
+        out.reduction = chooseReduction(w, h, min_face_size, detector_min_size, align_size);
+
+    out.image = imreadReduced(path, out.reduction);
+    if (out.image.empty())
+        return false;
+
+    if (out.reduction == 1) {
+        out.full_w = out.image.cols;
+        out.full_h = out.image.rows;
+    } else {
+        // 檔頭尺寸未套用 EXIF 旋轉，方向與解碼結果不同時對調
+        if ((w > h) != (out.image.cols > out.image.rows))
+            std::swap(w, h);
+        out.full_w = w;
+        out.full_h = h;
+    }
+    return true;
+}
+
+// 將人臉座標依 sx、sy 縮放
+void mapToFullResolution(const IngestImage& ingest, std::vector<FaceInfo>& faces)
+{
+    if (ingest.reduction == 1)
+        return;
+    scaleFaces(faces, (float)ingest.full_w / ingest.image.cols, (float)ingest.full_h / ingest.image.rows);
+}
+
+cv::Mat loadForAlignment(const IngestImage& ingest, const std::vector<FaceInfo>& faces, int align_size,
+                         std::vector<FaceInfo>& aligned_faces)
+{
+    aligned_faces = faces;
+    if (ingest.reduction == 1 || faces.empty())
+        return ingest.image;
+
+    // 最小的人臉縮小後仍有 align_size 像素時，對齊不會損失細節
+    int smallest = ingest.full_w;
+    for (auto it = faces.begin(); it != faces.end(); it++)
+        smallest = std::min(smallest, std::max(it->x[1] - it->x[0] + 1, it->y[1] - it->y[0] + 1));
+    int reduction = ingest.reduction;
+    while (reduction > 1 && smallest / reduction < align_size)
+        reduction /= 2;
+
+    cv::Mat image = reduction == ingest.reduction ? ingest.image : imreadReduced(ingest.path, reduction);
+    if (image.empty())
+        return image;
+    scaleFaces(aligned_faces, (float)image.cols / ingest.full_w, (float)image.rows / ingest.full_h);
+    return image;
+}
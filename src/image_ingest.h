@@ -0,0 +1,40 @@
+#ifndef IMAGE_INGEST_H
+#define IMAGE_INGEST_H
+
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "base.h"
+
+// 縮小解碼後的偵測影像，以及換算回原圖座標所需的資訊
+struct IngestImage {
+    std::string path;
+    cv::Mat image;          // 偵測用影像，可能是 1/2、1/4 或 1/8 解析度
+    int full_w = 0;         // 原圖尺寸 (已套用 EXIF 方向)
+    int full_h = 0;
+    int reduction = 1;      // 解碼縮小倍率 1/2/4/8
+};
+
+// 只讀 JPEG 檔頭取得尺寸，不是 JPEG 或格式不符時回傳 false
+bool readJpegSize(const std::string& path, int& w, int& h);
+
+// 依原圖短邊與要找的最小人臉 (原圖像素) 選擇縮小倍率，確保最小人臉縮小後仍不小於偵測器的 minsize；
+// align_size 大於 0 時也要不小於 align_size，讓對齊直接沿用同一份解碼結果，不必再解碼一次原圖
+int chooseReduction(int full_w, int full_h, int min_face_size, int detector_min_size, int align_size = 0);
+
+// 以 IMREAD_REDUCED_COLOR_{2,4,8} 在 DCT 域縮小解碼，reduction 為 1 時正常解碼
+cv::Mat imreadReduced(const std::string& path, int reduction);
+
+// 讀取偵測用影像；min_face_size 為 0 或非 JPEG 時以原解析度解碼
+bool loadForDetection(const std::string& path, int min_face_size, int detector_min_size, IngestImage& out,
+                      int align_size = 0);
+
+// 將偵測影像座標的人臉換算回原圖座標
+void mapToFullResolution(const IngestImage& ingest, std::vector<FaceInfo>& faces);
+
+// 依最小的人臉選擇足以對齊到 align_size 的解析度，只有人臉比 min_face_size 還小時才需要重新解碼；
+// faces 為原圖座標，aligned_faces 回傳對應到回傳影像座標的人臉
+cv::Mat loadForAlignment(const IngestImage& ingest, const std::vector<FaceInfo>& faces, int align_size,
+                         std::vector<FaceInfo>& aligned_faces);
+
+#endif // IMAGE_INGEST_H
@@ -1,11 +1,16 @@
 #include <vector>
 #include <iostream>
+#include <thread>
 #include <opencv2/opencv.hpp>
 #include "arcface.h"
 #include "mtcnn.h"
+#include "face_tracker.h"
 #include "face_database.h"
 #include "config.h"
 #include "base.h"
+#include "image_ingest.h"
+#include "scratch_arena.h"
+#include "roi_mask.h"
 
 
 
@@ -16,6 +21,7 @@ void printUsage() {
     std::cout << "Commands:" << std::endl;
     std::cout << "  register <name> <image_path>  - Register a new person" << std::endl;
     std::cout << "  recognize <image_path>        - Recognize person in image" << std::endl;
+    std::cout << "  track <frame_dir>             - Recognize persons across a frame sequence" << std::endl;
     std::cout << "  list                          - List all registered persons" << std::endl;
     std::cout << "  remove <name>                 - Remove a person from database" << std::endl;
     std::cout << "Options:" << std::endl;
@@ -57,10 +63,23 @@ int main(int argc, char* argv[])
     
     std::cout << "Using config file: " << config_file << std::endl;
     
-    // 初始化模型
+    FaceDatabase db(config.getDatabasePath("face_database.txt"));
+
+    // 只有需要偵測與辨識的命令才載入模型，list / remove 不碰任何網路
     MtcnnDetector detector("");
     Arcface arc("");
-    FaceDatabase db(config.getDatabasePath("face_database.txt"));
+    if (command == "register" || command == "recognize" || command == "track") {
+        // Arcface 在另一個執行緒與偵測器同時載入；Lnet 只在本命令會用到時才載入
+        bool use_lnet = detector.usesLnet() || (command == "track" && config.tracking_use_lnet);
+        bool arc_ok = false;
+        std::thread arc_loader([&arc, &arc_ok]() { arc_ok = arc.preload(); });
+        bool detector_ok = detector.preload(use_lnet);
+        arc_loader.join();
+        if (!detector_ok || !arc_ok) {
+            std::cerr << "Error: Failed to load models, check the model paths in " << config_file << std::endl;
+            return -1;
+        }
+    }
     
     if (command == "register" && argc == arg_start + 3) {
         std::string name = argv[arg_start + 1];
@@ -73,11 +92,16 @@ int main(int argc, char* argv[])
             return -1;
         }
         
-        // 轉換為 ncnn 格式
-        ncnn::Mat ncnn_img = ncnn::Mat::from_pixels(img.data, ncnn::Mat::PIXEL_BGR, img.cols, img.rows);
+        // 以 8-bit 影格視圖包裝解碼結果，不複製也不轉成 float
+        FrameView frame(img);
         
-        // 檢測人臉
-        std::vector<FaceInfo> results = detector.Detect(ncnn_img);
+        // 檢測人臉，註冊照只有一張大臉時由粗到細掃描並提前結束
+        std::vector<FaceInfo> results;
+        if (config.enroll_largest_face) {
+            results = detector.DetectLargest(frame, config.enroll_min_face_size, config.enroll_min_confidence);
+        } else {
+            results = detector.Detect(frame);
+        }
         if (results.empty()) {
             std::cerr << "Error: No face detected in image " << image_path << std::endl;
             return -1;
@@ -86,7 +110,7 @@ int main(int argc, char* argv[])
         std::cout << "Detected " << results.size() << " face(s), using the first one." << std::endl;
 
         // 預處理人臉
-        ncnn::Mat face = preprocess(ncnn_img, results[0]);
+        ncnn::Mat face = preprocess(frame, results[0]);
         
         // 提取特徵
         std::vector<float> feature = arc.getFeature(face);
@@ -97,7 +121,8 @@ int main(int argc, char* argv[])
 
             // 保存檢測到的人臉到 features 目錄
             if (config.save_detected_faces) {
-                cv::Mat face_img = ncnn2cv(face);
+                cv::Mat face_img;
+                ncnn2cv(face, face_img);
                 std::string face_filename = name + "_face.jpg";
                 std::string full_face_path = config.getFeaturePath(face_filename);
                 cv::imwrite(full_face_path, face_img);
@@ -111,42 +136,60 @@ int main(int argc, char* argv[])
     } else if (command == "recognize" && argc == arg_start + 2) {
         std::string image_path = argv[arg_start + 1];
         
-        // 讀取圖片
-        cv::Mat img = cv::imread(image_path);
-        if (img.empty()) {
+        // 讀取圖片，大張 JPEG 依要找的最小人臉在 DCT 域縮小解碼，縮小後最小人臉仍足以對齊到 112x112
+        IngestImage ingest;
+        int min_face_size = config.ingest_reduced_decode ? config.ingest_min_face_size : 0;
+        if (!loadForDetection(image_path, min_face_size, detector.getMinSize(), ingest, 112)) {
             std::cerr << "Error: Cannot read image " << image_path << std::endl;
             return -1;
         }
+        cv::Mat img = ingest.image;
+        if (ingest.reduction > 1) {
+            std::cout << "Decoded at 1/" << ingest.reduction << " resolution (" << img.cols << "x" << img.rows
+                      << " of " << ingest.full_w << "x" << ingest.full_h << ")" << std::endl;
+        }
         
-        // 轉換為 ncnn 格式
-        ncnn::Mat ncnn_img = ncnn::Mat::from_pixels(img.data, ncnn::Mat::PIXEL_BGR, img.cols, img.rows);
+        // 以 8-bit 影格視圖包裝解碼結果，不複製也不轉成 float
+        FrameView frame(img);
         
-        // 檢測人臉
-        std::vector<FaceInfo> results = detector.Detect(ncnn_img);
+        // 檢測人臉，高解析度圖片分塊平行偵測，只看設定的偵測區域
+        detector.setRoi(RoiMask::forSource(image_path));
+        std::vector<FaceInfo> results;
+        if (config.tiling_enabled) {
+            results = detector.DetectTiled(frame, config.tiling_tile_size, config.tiling_max_face_size, config.tiling_threads);
+        } else {
+            results = detector.Detect(frame);
+        }
         if (results.empty()) {
             std::cerr << "Error: No face detected in image " << image_path << std::endl;
             return -1;
         }
         
         std::cout << "Detected " << results.size() << " face(s):" << std::endl;
+
+        // 偵測座標換算回原圖，再取解析度足以讓最小人臉對齊到 112x112 的影像
+        mapToFullResolution(ingest, results);
+        std::vector<FaceInfo> aligned;
+        cv::Mat align_img = loadForAlignment(ingest, results, 112, aligned);
+        if (align_img.empty()) {
+            std::cerr << "Error: Cannot read image " << image_path << std::endl;
+            return -1;
+        }
         
         // 在圖片上標註結果
-        cv::Mat result_img = img.clone();
+        cv::Mat result_img = align_img.clone();
+
+        // 所有人臉平行提取特徵，再一次搜索數據庫
+        std::vector<float> features = arc.getFeatures(FrameView(align_img), aligned);
+        auto matches = db.searchPersons(features.data(), (int)results.size(), 0.6);
         
         for (size_t i = 0; i < results.size(); i++) {
-            // 預處理人臉
-            ncnn::Mat face = preprocess(ncnn_img, results[i]);
-            
-            // 提取特徵
-            std::vector<float> feature = arc.getFeature(face);
-            
-            // 在數據庫中搜索
-            auto match = db.searchPerson(feature, 0.6);
+            auto& match = matches[i];
 
             std::cout << "Face " << (i+1) << ": " << match.first << " (similarity: " << match.second << ")" << std::endl;
             
             // 在圖片上畫框和標籤
-            FaceInfo& face_info = results[i];
+            FaceInfo& face_info = aligned[i];
             cv::rectangle(result_img, 
                          cv::Point(face_info.x[0], face_info.y[0]), 
                          cv::Point(face_info.x[1], face_info.y[1]), 
@@ -174,6 +217,59 @@ int main(int argc, char* argv[])
             std::cout << "Recognition result saved as: " << full_result_path << std::endl;
         }
         
+    } else if (command == "track" && argc == arg_start + 2) {
+        std::string frame_dir = argv[arg_start + 1];
+
+        // 依檔名順序讀取幀序列
+        std::vector<cv::String> frame_files;
+        cv::glob(frame_dir, frame_files, false);
+        if (frame_files.empty()) {
+            std::cerr << "Error: No frames found in " << frame_dir << std::endl;
+            return -1;
+        }
+
+        detector.setRoi(RoiMask::forSource(frame_dir));
+        FaceTracker tracker(detector);
+        int keyframes = 0;
+        int idle_frames = 0;
+        std::vector<std::pair<std::string, float> > matches;
+
+        for (size_t f = 0; f < frame_files.size(); f++) {
+            cv::Mat img = cv::imread(frame_files[f]);
+            if (img.empty()) {
+                std::cerr << "Warning: Cannot read frame " << frame_files[f] << std::endl;
+                continue;
+            }
+
+            FrameView frame(img);
+            resetScratchArena();
+
+            // 關鍵幀完整偵測，其餘幀只更新追蹤框
+            std::vector<FaceInfo> results = tracker.Detect(frame);
+            if (tracker.isKeyframe()) {
+                keyframes++;
+            }
+            if (tracker.isIdle()) {
+                idle_frames++;
+            }
+
+            std::cout << "Frame " << (f+1) << (tracker.isKeyframe() ? " [keyframe]" : "")
+                      << (tracker.isIdle() ? " [idle]" : "") << ": " << results.size() << " face(s)" << std::endl;
+
+            // 畫面沒變動時人臉與上一幀相同，沿用上一次的辨識結果
+            if (!tracker.isIdle()) {
+                std::vector<float> features = arc.getFeatures(frame, results);
+                matches = db.searchPersons(features.data(), (int)results.size(), config.face_similarity_threshold);
+            }
+            for (size_t i = 0; i < results.size(); i++) {
+                auto& match = matches[i];
+                std::cout << "  Face " << (i+1) << ": " << match.first << " (similarity: " << match.second << ")" << std::endl;
+            }
+        }
+
+        std::cout << "Processed " << frame_files.size() << " frame(s), " << keyframes << " keyframe(s), "
+                  << idle_frames << " idle frame(s)." << std::endl;
+
     } else if (command == "list") {
         auto persons = db.getAllPersons();
         std::cout << "Database contains " << persons.size() << " person(s):" << std::endl;
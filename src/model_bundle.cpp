@@ -0,0 +1,224 @@
+#include "model_bundle.h"
+#include "config.h"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// 檔頭：magic + 版本 + 項目數，接著是 Entry 表，各段資料依頁對齊
+static const char BUNDLE_MAGIC[4] = {'F', 'R', 'M', 'B'};
+static const uint32_t BUNDLE_VERSION = 1;
+static const uint64_t BUNDLE_ALIGN = 4096;
+
+struct BundleHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+static uint64_t alignUp(uint64_t v)
+{
+    return (v + BUNDLE_ALIGN - 1) / BUNDLE_ALIGN * BUNDLE_ALIGN;
+}
+
+static bool endsWith(const std::string& s, const std::string& suffix)
+{
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static bool readFile(const std::string& path, std::vector<char>& data)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+        return false;
+    data.resize((size_t)file.tellg());
+    file.seekg(0);
+    return (bool)file.read(data.data(), data.size());
+}
+
+ModelBundle::ModelBundle() : data(nullptr), size(0)
+{
+}
+
+ModelBundle::~ModelBundle()
+{
+    close();
+}
+
+bool ModelBundle::open(const std::string& path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Cannot open model bundle: " << path << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(BundleHeader)) {
+        std::cerr << "Invalid model bundle: " << path << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        std::cerr << "Cannot mmap model bundle: " << path << std::endl;
+        return false;
+    }
+    data = (const unsigned char*)mapped;
+    size = st.st_size;
+
+    BundleHeader header;
+    memcpy(&header, data, sizeof(header));
+    size_t table_end = sizeof(BundleHeader) + (size_t)header.count * sizeof(Entry);
+    if (memcmp(header.magic, BUNDLE_MAGIC, 4) != 0 || header.version != BUNDLE_VERSION || table_end > size) {
+        std::cerr << "Invalid model bundle: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    entries.resize(header.count);
+    memcpy(entries.data(), data + sizeof(BundleHeader), header.count * sizeof(Entry));
+    for (const Entry& e : entries) {
+        if (e.param_offset + e.param_size > size || e.model_offset + e.model_size > size) {
+            std::cerr << "Truncated model bundle: " << path << std::endl;
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void ModelBundle::close()
+{
+    if (data)
+        munmap((void*)data, size);
+    data = nullptr;
+    size = 0;
+    entries.clear();
+}
+
+const ModelBundle::Entry* ModelBundle::find(const std::string& name) const
+{
+    for (const Entry& e : entries) {
+        if (strncmp(e.name, name.c_str(), sizeof(e.name)) == 0)
+            return &e;
+    }
+    return nullptr;
+}
+
+bool ModelBundle::load(ncnn::Net& net, const std::string& name) const
+{
+    const Entry* found = find(name);
+    if (!found)
+        return false;
+    const Entry& e = *found;
+
+    // 文字 param 存放時含結尾 '\0'，可直接交給 load_param_mem
+    int ret = (e.flags & BINARY_PARAM) ? net.load_param(data + e.param_offset)
+                                       : net.load_param_mem((const char*)(data + e.param_offset));
+    if (ret < 0) {
+        std::cerr << "Failed to load param of " << name << " from model bundle" << std::endl;
+        return false;
+    }
+    // 權重段頁對齊，ncnn 載入時引用映射記憶體；create_pipeline 重排過的層則另存一份
+    if (net.load_model(data + e.model_offset) <= 0) {
+        std::cerr << "Failed to load model of " << name << " from model bundle" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ModelBundle::pack(const std::string& path, const std::vector<std::string>& names,
+                       const std::vector<std::string>& param_files, const std::vector<std::string>& bin_files)
+{
+    std::vector<Entry> table(names.size());
+    std::vector<std::vector<char>> params(names.size()), models(names.size());
+
+    uint64_t offset = alignUp(sizeof(BundleHeader) + names.size() * sizeof(Entry));
+    for (size_t i = 0; i < names.size(); i++) {
+        if (!readFile(param_files[i], params[i]) || !readFile(bin_files[i], models[i])) {
+            std::cerr << "Cannot read model files of " << names[i] << std::endl;
+            return false;
+        }
+        Entry& e = table[i];
+        memset(&e, 0, sizeof(e));
+        strncpy(e.name, names[i].c_str(), sizeof(e.name) - 1);
+        if (endsWith(param_files[i], ".param.bin"))
+            e.flags |= BINARY_PARAM;
+        else
+            params[i].push_back('\0');
+
+        e.param_offset = offset;
+        e.param_size = params[i].size();
+        offset = alignUp(offset + e.param_size);
+        e.model_offset = offset;
+        e.model_size = models[i].size();
+        offset = alignUp(offset + e.model_size);
+    }
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "Cannot write model bundle: " << path << std::endl;
+        return false;
+    }
+    BundleHeader header;
+    memcpy(header.magic, BUNDLE_MAGIC, 4);
+    header.version = BUNDLE_VERSION;
+    header.count = (uint32_t)names.size();
+    header.reserved = 0;
+    out.write((const char*)&header, sizeof(header));
+    out.write((const char*)table.data(), table.size() * sizeof(Entry));
+
+    auto pad_to = [&out](uint64_t pos) {
+        static const char zeros[BUNDLE_ALIGN] = {0};
+        uint64_t cur = (uint64_t)out.tellp();
+        if (pos > cur)
+            out.write(zeros, pos - cur);
+    };
+    for (size_t i = 0; i < names.size(); i++) {
+        pad_to(table[i].param_offset);
+        out.write(params[i].data(), params[i].size());
+        pad_to(table[i].model_offset);
+        out.write(models[i].data(), models[i].size());
+    }
+    return (bool)out;
+}
+
+const ModelBundle* ModelBundle::shared()
+{
+    // 各網路平行載入時同時呼叫，靜態區域變數保證只開啟一次
+    static ModelBundle* bundle = []() -> ModelBundle* {
+        Config& config = Config::getInstance();
+        if (config.models_bundle.empty())
+            return nullptr;
+        static ModelBundle instance;
+        return instance.open(config.getModelPath(config.models_bundle)) ? &instance : nullptr;
+    }();
+    return bundle;
+}
+
+bool loadNet(ncnn::Net& net, const std::string& name, const std::string& param_path, const std::string& bin_path)
+{
+    const ModelBundle* bundle = ModelBundle::shared();
+    if (bundle && bundle->find(name))
+        return bundle->load(net, name);
+
+    int ret = endsWith(param_path, ".param.bin") ? net.load_param_bin(param_path.c_str())
+                                                 : net.load_param(param_path.c_str());
+    if (ret != 0) {
+        std::cerr << "Failed to load param: " << param_path << std::endl;
+        return false;
+    }
+    if (net.load_model(bin_path.c_str()) != 0) {
+        std::cerr << "Failed to load model: " << bin_path << std::endl;
+        return false;
+    }
+    return true;
+}
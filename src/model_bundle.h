@@ -0,0 +1,56 @@
+#ifndef MODEL_BUNDLE_H
+#define MODEL_BUNDLE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "net.h"
+
+// 模型包：多個網路的 param 與權重依頁對齊存放在同一個檔案，以 mmap 開啟後一次載入，
+// 省去逐一開檔與讀取複製。多數層的 create_pipeline 仍會把權重重排到自己的 heap 緩衝區
+class ModelBundle {
+public:
+    struct Entry {
+        char name[32];
+        uint32_t flags;          // BINARY_PARAM 表示 param 為 ncnn 二進位格式
+        uint32_t reserved;
+        uint64_t param_offset;
+        uint64_t param_size;
+        uint64_t model_offset;
+        uint64_t model_size;
+    };
+
+    enum { BINARY_PARAM = 1 };
+
+    ModelBundle();
+    ~ModelBundle();
+
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return data != nullptr; }
+
+    const Entry* find(const std::string& name) const;
+
+    // 從模型包載入指定網路，找不到時回傳 false
+    bool load(ncnn::Net& net, const std::string& name) const;
+
+    // 將多個 param/bin 打包成模型包
+    static bool pack(const std::string& path, const std::vector<std::string>& names,
+                     const std::vector<std::string>& param_files, const std::vector<std::string>& bin_files);
+
+    // 依設定檔開啟的共用模型包，未設定時回傳 nullptr
+    static const ModelBundle* shared();
+
+private:
+    const unsigned char* data;
+    size_t size;
+    std::vector<Entry> entries;
+
+    ModelBundle(const ModelBundle&) = delete;
+    ModelBundle& operator=(const ModelBundle&) = delete;
+};
+
+// 載入單一網路：設定了模型包時從 mmap 載入，否則讀取檔案 (.param.bin 視為二進位 param)
+bool loadNet(ncnn::Net& net, const std::string& name, const std::string& param_path, const std::string& bin_path);
+
+#endif // MODEL_BUNDLE_H
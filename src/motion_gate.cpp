@@ -0,0 +1,161 @@
+#include "motion_gate.h"
+#include <cstdlib>
+#include <algorithm>
+
+// 區域尺寸對齊到此倍數，讓 Pnet 的尺度規劃快取容易命中
+static const int kRegionAlign = 32;
+
+MotionGate::MotionGate()
+{
+    reset();
+}
+
+void MotionGate::reset()
+{
+    frame_w = frame_h = 0;
+    step = 1;
+    small_w = small_h = 0;
+    grid_w = grid_h = 0;
+    idle_frames = 0;
+    has_reference = false;
+    full_frame = false;
+    regions.clear();
+}
+
+void MotionGate::downsample(const FrameView& img)
+{
+    if (img.w != frame_w || img.h != frame_h) {
+        frame_w = img.w;
+        frame_h = img.h;
+        step = std::max(1, (img.w + width - 1) / std::max(width, 1));
+        small_w = img.w / step;
+        small_h = img.h / step;
+        grid_w = (small_w + cell_size - 1) / cell_size;
+        grid_h = (small_h + cell_size - 1) / cell_size;
+        current.resize((size_t)small_w * small_h);
+        cell_counts.resize((size_t)grid_w * grid_h);
+        has_reference = false;
+    }
+
+    // 每個取樣區塊只讀四個象限中心的像素，換算灰階後平均
+    int q0 = step / 4, q1 = (3 * step) / 4;
+    for (int y = 0; y < small_h; y++) {
+        const unsigned char* row0 = img.data + (size_t)(y * step + q0) * img.stride;
+        const unsigned char* row1 = img.data + (size_t)(y * step + q1) * img.stride;
+        unsigned char* dst = &current[(size_t)y * small_w];
+        for (int x = 0; x < small_w; x++) {
+            int x0 = (x * step + q0) * 3, x1 = (x * step + q1) * 3;
+            int sum = 0;
+            const unsigned char* p[4] = {row0 + x0, row0 + x1, row1 + x0, row1 + x1};
+            for (int i = 0; i < 4; i++)
+                sum += p[i][0] * 29 + p[i][1] * 150 + p[i][2] * 77;
+            dst[x] = (unsigned char)(sum >> 10);
+        }
+    }
+}
+
+void MotionGate::fullFrame()
+{
+    regions.assign(1, cv::Rect(0, 0, frame_w, frame_h));
+    idle_frames = 0;
+    full_frame = true;
+}
+
+bool MotionGate::update(const FrameView& img)
+{
+    regions.clear();
+    full_frame = false;
+    downsample(img);
+    if (!has_reference || small_w == 0 || small_h == 0) {
+        fullFrame();
+        return true;
+    }
+
+    std::fill(cell_counts.begin(), cell_counts.end(), 0);
+    bool any = false;
+    for (int y = 0; y < small_h; y++) {
+        const unsigned char* cur = &current[(size_t)y * small_w];
+        const unsigned char* ref = &reference[(size_t)y * small_w];
+        int* counts = &cell_counts[(size_t)(y / cell_size) * grid_w];
+        for (int x = 0; x < small_w; x++) {
+            if (std::abs(cur[x] - ref[x]) > pixel_threshold) {
+                counts[x / cell_size]++;
+                any = true;
+            }
+        }
+    }
+
+    if (!any || std::none_of(cell_counts.begin(), cell_counts.end(),
+                             [this](int c) { return c >= min_cell_pixels; })) {
+        if (max_idle_frames > 0 && ++idle_frames >= max_idle_frames) {
+            fullFrame();
+            return true;
+        }
+        return false;
+    }
+    idle_frames = 0;
+
+    // 以 8 連通找出變動格子組成的區塊，cell_counts 設為 -1 表示已走訪
+    for (int gy = 0; gy < grid_h; gy++) {
+        for (int gx = 0; gx < grid_w; gx++) {
+            if (cell_counts[gy * grid_w + gx] < min_cell_pixels)
+                continue;
+            int bx0 = gx, by0 = gy, bx1 = gx, by1 = gy;
+            stack.clear();
+            stack.push_back(gy * grid_w + gx);
+            cell_counts[gy * grid_w + gx] = -1;
+            while (!stack.empty()) {
+                int cell = stack.back();
+                stack.pop_back();
+                int cx = cell % grid_w, cy = cell / grid_w;
+                bx0 = std::min(bx0, cx);
+                bx1 = std::max(bx1, cx);
+                by0 = std::min(by0, cy);
+                by1 = std::max(by1, cy);
+                for (int ny = std::max(cy - 1, 0); ny <= std::min(cy + 1, grid_h - 1); ny++) {
+                    for (int nx = std::max(cx - 1, 0); nx <= std::min(cx + 1, grid_w - 1); nx++) {
+                        int n = ny * grid_w + nx;
+                        if (cell_counts[n] >= min_cell_pixels) {
+                            cell_counts[n] = -1;
+                            stack.push_back(n);
+                        }
+                    }
+                }
+            }
+
+            // 換回原圖座標並外擴，尺寸對齊 kRegionAlign
+            int scale = cell_size * step;
+            int x0 = bx0 * scale, y0 = by0 * scale;
+            int w = (bx1 - bx0 + 1) * scale, h = (by1 - by0 + 1) * scale;
+            int pad = (int)(std::max(w, h) * margin);
+            w = (w + 2 * pad + kRegionAlign - 1) / kRegionAlign * kRegionAlign;
+            h = (h + 2 * pad + kRegionAlign - 1) / kRegionAlign * kRegionAlign;
+            x0 = std::max(0, std::min(x0 - pad, frame_w - w));
+            y0 = std::max(0, std::min(y0 - pad, frame_h - h));
+            regions.push_back(cv::Rect(x0, y0, std::min(w, frame_w - x0), std::min(h, frame_h - y0)));
+        }
+    }
+
+    // 外擴後重疊的區域合併成一個，避免同一塊像素偵測兩次
+    for (bool merged = true; merged; ) {
+        merged = false;
+        for (size_t i = 0; i < regions.size() && !merged; i++) {
+            for (size_t j = i + 1; j < regions.size(); j++) {
+                if ((regions[i] & regions[j]).area() > 0) {
+                    regions[i] = regions[i] | regions[j];
+                    regions.erase(regions.begin() + j);
+                    merged = true;
+                    break;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+void MotionGate::accept()
+{
+    reference.swap(current);
+    current.resize(reference.size());
+    has_reference = true;
+}
@@ -0,0 +1,48 @@
+#ifndef MOTION_GATE_H
+#define MOTION_GATE_H
+
+#include <vector>
+#include "base.h"
+
+// 固定攝影機的變動偵測：在縮小的灰階影格上與參考幀相減，
+// 沒有變動時整幀略過偵測，有變動時只回傳變動區塊的外接矩形
+class MotionGate {
+public:
+    MotionGate();
+
+    // 比較本幀與參考幀；回傳 false 表示沒有變動，
+    // 回傳 true 時 getRegions() 為需要重新偵測的區域 (原圖像素，已外擴)
+    bool update(const FrameView& img);
+    const std::vector<cv::Rect>& getRegions() const { return regions; }
+    // 本幀需要整幀重新偵測 (尚無參考幀、尺寸改變或閒置過久)
+    bool isFullFrame() const { return full_frame; }
+
+    // 本幀已完成偵測，之後以本幀作為比較的參考
+    void accept();
+    void reset();
+
+    int width = 160;             // 縮小後的灰階影格寬度
+    int pixel_threshold = 20;    // 灰階差超過此值的像素視為變動
+    int cell_size = 8;           // 變動像素以 cell_size × cell_size 的格子統計
+    int min_cell_pixels = 4;     // 格子內至少這麼多變動像素才算變動，濾掉雜訊
+    float margin = 0.5f;         // 變動區塊向外擴張的比例，涵蓋只有部分在動的人臉
+    int max_idle_frames = 100;   // 連續這麼多幀沒有變動時仍做一次完整偵測，0 表示不做
+
+private:
+    int frame_w, frame_h;
+    int step;                    // 原圖到縮小影格的取樣間距
+    int small_w, small_h;
+    int grid_w, grid_h;
+    int idle_frames;
+    bool has_reference;
+    bool full_frame;
+    std::vector<unsigned char> reference, current;
+    std::vector<int> cell_counts;
+    std::vector<int> stack;
+    std::vector<cv::Rect> regions;
+
+    void downsample(const FrameView& img);
+    void fullFrame();
+};
+
+#endif // MOTION_GATE_H
@@ -1,35 +1,84 @@
 #include "mtcnn.h"
 #include "config.h"
+#include "pool_allocator.h"
+#include "model_bundle.h"
+#include <thread>
+#include <stdexcept>
+
+#if _OPENMP
+#include <omp.h>
+#endif
 
 MtcnnDetector::MtcnnDetector(std::string model_folder)
 {
     Config& config = Config::getInstance();
-    
-    std::vector<std::string> param_files;
-    std::vector<std::string> bin_files;
 
     param_files = {
-        config.getModelPath(config.mtcnn_det1_param),
-        config.getModelPath(config.mtcnn_det2_param),
-        config.getModelPath(config.mtcnn_det3_param),
-        config.getModelPath(config.mtcnn_det4_param)
+        config.getNetModelPath(config.mtcnn_det1_param),
+        config.getNetModelPath(config.mtcnn_det2_param),
+        config.getNetModelPath(config.mtcnn_det3_param),
+        config.getNetModelPath(config.mtcnn_det4_param)
     };
     bin_files = {
-        config.getModelPath(config.mtcnn_det1_bin),
-        config.getModelPath(config.mtcnn_det2_bin),
-        config.getModelPath(config.mtcnn_det3_bin),
-        config.getModelPath(config.mtcnn_det4_bin)
+        config.getNetModelPath(config.mtcnn_det1_bin),
+        config.getNetModelPath(config.mtcnn_det2_bin),
+        config.getNetModelPath(config.mtcnn_det3_bin),
+        config.getNetModelPath(config.mtcnn_det4_bin)
     };
 
+    applyNetOptions(this->Pnet, config.det1_options);
+    applyNetOptions(this->Rnet, config.det2_options);
+    applyNetOptions(this->Onet, config.det3_options);
+    applyNetOptions(this->Lnet, config.det4_options);
+
+    this->nms_grid = config.nms_grid;
+    this->max_pnet_candidates = config.max_pnet_candidates;
+    this->max_rnet_candidates = config.max_rnet_candidates;
+    this->time_budget_ms = config.time_budget_ms;
+    this->max_face_size = config.max_face_size;
+    this->adaptive_scales = config.adaptive_scales;
+    this->detect_scale = config.detect_scale > 0 && config.detect_scale < 1 ? config.detect_scale : 1.0f;
+    this->use_lnet = config.detector_use_lnet;
+    size_prior.margin = config.adaptive_margin;
+    size_prior.warmup_faces = config.adaptive_warmup_faces;
+    size_prior.refresh_interval = config.adaptive_refresh_interval;
+}
+
+static const char* kNetNames[4] = {"det1", "det2", "det3", "det4"};
 
-    this->Pnet.load_param(param_files[0].c_str());
-    this->Pnet.load_model(bin_files[0].c_str());
-    this->Rnet.load_param(param_files[1].c_str());
-    this->Rnet.load_model(bin_files[1].c_str());
-    this->Onet.load_param(param_files[2].c_str());
-    this->Onet.load_model(bin_files[2].c_str());
-    this->Lnet.load_param(param_files[3].c_str());
-    this->Lnet.load_model(bin_files[3].c_str());
+bool MtcnnDetector::ensureLoaded(int k)
+{
+    ncnn::Net* nets[4] = {&this->Pnet, &this->Rnet, &this->Onet, &this->Lnet};
+    // call_once 讓分塊偵測的多個執行緒同時第一次使用時只載入一次，結果記在 loaded
+    std::call_once(load_flags[k], [&]() {
+        loaded[k] = loadNet(*nets[k], kNetNames[k], param_files[k], bin_files[k]);
+    });
+    return loaded[k];
+}
+
+ncnn::Net& MtcnnDetector::getNet(int k)
+{
+    // 載入失敗的空網路在 extract 時才會靜默出錯，第一次使用就中止
+    if (!ensureLoaded(k))
+        throw std::runtime_error(std::string("Failed to load network ") + kNetNames[k]);
+    ncnn::Net* nets[4] = {&this->Pnet, &this->Rnet, &this->Onet, &this->Lnet};
+    return *nets[k];
+}
+
+bool MtcnnDetector::preload(bool use_lnet)
+{
+    // 四個網路互不相依，各自以一個執行緒平行載入
+    int count = use_lnet ? 4 : 3;
+    std::vector<std::thread> loaders;
+    for (int k = 0; k < count; k++) {
+        loaders.emplace_back([this, k]() { ensureLoaded(k); });
+    }
+    for (std::thread& t : loaders)
+        t.join();
+    bool ok = true;
+    for (int k = 0; k < count; k++)
+        ok = ok && loaded[k];
+    return ok;
 }
 
 MtcnnDetector::~MtcnnDetector()
@@ -40,79 +89,677 @@ MtcnnDetector::~MtcnnDetector()
     this->Lnet.clear();
 }
 
-std::vector<FaceInfo> MtcnnDetector::Detect(ncnn::Mat img)
+// 影像金字塔的一層：縮放比例與輸入尺寸
+struct ScaleLevel {
+    double scale;
+    int ws, hs;
+};
+
+// 固定 (寬, 高, minsize, factor, max_face_size) 的尺度規劃，
+// 解析度固定的攝影機只在第一幀計算一次。規劃只存各層的尺寸，
+// 像素與輸入張量由同一執行緒的所有規劃共用，快取多少種尺寸都不會多佔記憶體
+struct ScalePlan {
+    int img_w = 0, img_h = 0;
+    float minsize = 0, factor = 0;
+    int max_face_size = 0;
+    std::vector<ScaleLevel> levels;
+    size_t max_pixels = 0;               // 最大一層的 BGR 位元組數
+    size_t max_input = 0;                // 最大一層的 Pnet 輸入 float 數 (含 ncnn 通道對齊)
+    size_t last_used = 0;
+
+    bool matches(int w, int h, float min_size, float scale_factor, int max_size) const
+    {
+        return img_w == w && img_h == h && minsize == min_size && factor == scale_factor &&
+               max_face_size == max_size;
+    }
+};
+
+// 單幀候選框工作區，每個執行緒一份 (分塊偵測時各區塊互不干擾)。
+// 各階段就地篩選同一個 boxes 陣列，容量跨幀保留，穩定後不再配置
+struct CandidateArena {
+    std::vector<FaceInfo> boxes;         // 目前存活的候選框
+    std::vector<FaceInfo> sorted;        // NMS 依分數重排時與 boxes 交換的緩衝區
+    std::vector<int> order;              // NMS 存活框的索引
+    std::vector<int> indices;            // Pnet 超過閾值的位置
+    BoxArray scale_boxes;                // Pnet 單一尺度的候選框
+    BoxArray nms_boxes;                  // NMS 用的 SoA 副本
+    std::vector<unsigned char> scale_suppressed, nms_suppressed;
+    size_t copied_bytes = 0;             // 本次呼叫複製 FaceInfo 的位元組
+    std::vector<unsigned char> downscaled;  // detect_scale 縮小後的偵測影格
+    std::vector<ScalePlan> plans;        // 最近用過的尺度規劃 (分塊偵測時各種區塊尺寸各一份)
+    std::vector<unsigned char> pyramid_pixels;  // Pnet 各層共用的縮放後 BGR 像素
+    std::vector<float> pyramid_input;    // Pnet 各層共用的輸入張量，依用過的最大一層配置
+    ncnn::Mat rnet_input, onet_input;    // Rnet / Onet 每個候選框共用的輸入張量
+    ncnn::Mat lnet_input, lnet_patch;    // Lnet 的 15 通道輸入與單一關鍵點的裁切
+    size_t plan_clock = 0;
+    std::chrono::steady_clock::time_point deadline;  // 本次呼叫的截止時間
+    float band_min = 0, band_max = 0;    // Pnet 只跑涵蓋此人臉邊長範圍的尺度，0 表示不限制
+    size_t levels_run = 0, levels_skipped = 0;
+    size_t roi_rejected = 0;
+    bool pnet_capped = false, rnet_capped = false, budget_exceeded = false;
+
+    // 是否已超過截止時間；未設定時間上限時不讀時鐘
+    bool expired()
+    {
+        if (budget_exceeded)
+            return true;
+        if (deadline == std::chrono::steady_clock::time_point::max())
+            return false;
+        budget_exceeded = std::chrono::steady_clock::now() >= deadline;
+        return budget_exceeded;
+    }
+
+    // 超過時間上限後，Rnet / Onet 仍至少處理分數最高的這幾個框，
+    // 避免預算用在 Pnet 後整幀沒有任何結果
+    static const size_t kMinSurvivors = 4;
+
+    // 已處理 processed 個框後是否該停止；前 kMinSurvivors 個一定處理
+    bool stopAt(size_t processed)
+    {
+        return processed >= kMinSurvivors && expired();
+    }
+
+    // 各階段依分數由高到低處理，截斷時丟掉的才會是分數低的框；已排序時不搬動
+    void sortByScore(std::vector<FaceInfo>& bboxs)
+    {
+        auto higher = [](const FaceInfo& a, const FaceInfo& b) { return a.score > b.score; };
+        if (std::is_sorted(bboxs.begin(), bboxs.end(), higher))
+            return;
+        std::stable_sort(bboxs.begin(), bboxs.end(), higher);
+        copied_bytes += bboxs.size() * sizeof(FaceInfo);
+    }
+
+    // 候選框已依分數由高到低排序，只保留前 limit 個
+    static void cap(std::vector<FaceInfo>& boxes, int limit, bool& capped)
+    {
+        if (limit > 0 && boxes.size() > (size_t)limit) {
+            boxes.resize(limit);
+            capped = true;
+        }
+    }
+
+    // 各緩衝區目前的容量，比較前後即可得知本次呼叫重新配置了幾次
+    void capacities(size_t* caps) const
+    {
+        caps[0] = boxes.capacity();
+        caps[1] = sorted.capacity();
+        caps[2] = order.capacity();
+        caps[3] = indices.capacity();
+        caps[4] = scale_boxes.score.capacity();
+        caps[5] = nms_boxes.score.capacity();
+        caps[6] = scale_suppressed.capacity();
+        caps[7] = nms_suppressed.capacity();
+    }
+};
+
+static CandidateArena& candidateArena()
+{
+    static thread_local CandidateArena arena;
+    return arena;
+}
+
+// 一次偵測呼叫的統計範圍：開始時清空 boxes，結束時累計配置次數與複製量
+class MtcnnDetector::FrameScope {
+public:
+    FrameScope(MtcnnDetector& detector, std::chrono::steady_clock::time_point deadline)
+        : detector(detector), arena(candidateArena())
+    {
+        arena.boxes.clear();
+        arena.copied_bytes = 0;
+        arena.deadline = deadline;
+        arena.pnet_capped = arena.rnet_capped = arena.budget_exceeded = false;
+        arena.band_min = arena.band_max = 0;
+        arena.levels_run = arena.levels_skipped = 0;
+        arena.roi_rejected = 0;
+        arena.capacities(caps);
+    }
+    ~FrameScope()
+    {
+        size_t after[8];
+        arena.capacities(after);
+        size_t allocations = 0;
+        for (int i = 0; i < 8; i++) {
+            // BoxArray 由 10 個欄位組成，容量增長即 10 次配置
+            if (after[i] > caps[i])
+                allocations += (i == 4 || i == 5) ? 10 : 1;
+        }
+        detector.stat_allocations += allocations;
+        detector.stat_copied_bytes += arena.copied_bytes;
+        detector.stat_pnet_capped += arena.pnet_capped;
+        detector.stat_rnet_capped += arena.rnet_capped;
+        detector.stat_budget_exceeded += arena.budget_exceeded;
+        detector.stat_pnet_levels += arena.levels_run;
+        detector.stat_pnet_levels_skipped += arena.levels_skipped;
+        detector.stat_roi_rejected += arena.roi_rejected;
+    }
+
+    // 把存活的候選框輸出成回傳值，計入一次配置與對應的複製量
+    std::vector<FaceInfo> results()
+    {
+        detector.stat_allocations += arena.boxes.empty() ? 0 : 1;
+        detector.stat_budget_empty += arena.budget_exceeded && arena.boxes.empty();
+        arena.copied_bytes += arena.boxes.size() * sizeof(FaceInfo);
+        return std::vector<FaceInfo>(arena.boxes.begin(), arena.boxes.end());
+    }
+
+    MtcnnDetector& detector;
+    CandidateArena& arena;
+
+private:
+    size_t caps[8];
+};
+
+DetectorStats MtcnnDetector::getStats() const
+{
+    DetectorStats stats;
+    stats.calls = stat_calls;
+    stats.allocations = stat_allocations;
+    stats.copied_bytes = stat_copied_bytes;
+    stats.pnet_capped = stat_pnet_capped;
+    stats.rnet_capped = stat_rnet_capped;
+    stats.budget_exceeded = stat_budget_exceeded;
+    stats.budget_empty = stat_budget_empty;
+    stats.plan_builds = stat_plan_builds;
+    stats.pnet_levels = stat_pnet_levels;
+    stats.pnet_levels_skipped = stat_pnet_levels_skipped;
+    stats.roi_rejected = stat_roi_rejected;
+    return stats;
+}
+
+void MtcnnDetector::resetStats()
+{
+    stat_calls = 0;
+    stat_allocations = 0;
+    stat_copied_bytes = 0;
+    stat_pnet_capped = 0;
+    stat_rnet_capped = 0;
+    stat_budget_exceeded = 0;
+    stat_budget_empty = 0;
+    stat_plan_builds = 0;
+    stat_pnet_levels = 0;
+    stat_pnet_levels_skipped = 0;
+    stat_roi_rejected = 0;
+}
+
+std::chrono::steady_clock::time_point MtcnnDetector::frameDeadline() const
+{
+    if (this->time_budget_ms <= 0)
+        return std::chrono::steady_clock::time_point::max();
+    return std::chrono::steady_clock::now() +
+           std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+               std::chrono::duration<double, std::milli>(this->time_budget_ms));
+}
+
+MtcnnDetector::FrameParams MtcnnDetector::frameParams(const FrameView& img)
+{
+    FrameParams params;
+    params.deadline = frameDeadline();
+    if (this->adaptive_scales)
+        size_prior.band(params.band_min, params.band_max);
+    params.frame_w = img.w;
+    params.frame_h = img.h;
+    return params;
+}
+
+// 將區塊座標平移回完整影格
+static void offsetFaces(std::vector<FaceInfo>& faces, int dx, int dy)
+{
+    if (dx == 0 && dy == 0)
+        return;
+    for (auto it = faces.begin(); it != faces.end(); it++)
+    {
+        it->x[0] += dx;
+        it->x[1] += dx;
+        it->y[0] += dy;
+        it->y[1] += dy;
+        for (int p = 0; p < 5; p++)
+        {
+            it->landmark[2 * p] += dx;
+            it->landmark[2 * p + 1] += dy;
+        }
+    }
+}
+
+// 依 detect_scale 縮小成偵測用的影格，像素存在目前執行緒的工作區；scale 為 1 時直接回傳原圖
+static FrameView downscaleFrame(const FrameView& img, float scale)
+{
+    int ws = (int)round(img.w * scale);
+    int hs = (int)round(img.h * scale);
+    if (scale >= 1.0f || ws <= 0 || hs <= 0 || (ws == img.w && hs == img.h))
+        return img;
+    std::vector<unsigned char>& pixels = candidateArena().downscaled;
+    pixels.resize((size_t)ws * hs * 3);
+    ncnn::resize_bilinear_c3(img.data, img.w, img.h, img.stride, pixels.data(), ws, hs, ws * 3);
+    return FrameView(pixels.data(), ws, hs, ws * 3);
+}
+
+// 將縮小影格上的人臉換算回原圖，之後的對齊與特徵提取都從原解析度取樣
+static void restoreScale(std::vector<FaceInfo>& faces, const FrameView& img, const FrameView& view)
+{
+    if (view.w != img.w || view.h != img.h)
+        scaleFaces(faces, (float)img.w / view.w, (float)img.h / view.h);
+}
+
+std::vector<FaceInfo> MtcnnDetector::Detect(const FrameView& img)
+{
+    stat_calls++;
+    FrameView view = downscaleFrame(img, this->detect_scale);
+    std::vector<FaceInfo> results = detectFrame(view);
+    restoreScale(results, img, view);
+    return results;
+}
+
+std::vector<FaceInfo> MtcnnDetector::detectFrame(const FrameView& img)
+{
+    FrameParams params = frameParams(img);
+
+    // 只偵測偵測區域的外接矩形，是原圖的子視圖，不複製像素
+    std::vector<FaceInfo> results;
+    cv::Rect area = roi.bounds(img.w, img.h);
+    if (area.area() > 0)
+    {
+        params.offset_x = area.x;
+        params.offset_y = area.y;
+        results = Detect(img.roi(area.x, area.y, area.width, area.height), params);
+        offsetFaces(results, area.x, area.y);
+    }
+    if (this->adaptive_scales)
+        size_prior.observe(results);
+    return results;
+}
+
+std::vector<FaceInfo> MtcnnDetector::Detect(const FrameView& img, const FrameParams& params)
 {
     int img_w = img.w;
     int img_h = img.h;
 
-    std::vector<FaceInfo> pnet_results = Pnet_Detect(img);
-    doNms(pnet_results, 0.7, "union");
-    refine(pnet_results, img_h, img_w, true);
+    FrameScope frame(*this, params.deadline);
+    CandidateArena& arena = frame.arena;
+    std::vector<FaceInfo>& boxes = arena.boxes;
+    arena.band_min = params.band_min;
+    arena.band_max = params.band_max;
 
-    std::vector<FaceInfo> rnet_results = Rnet_Detect(img, pnet_results);
-    doNms(rnet_results, 0.7, "union");
-    refine(rnet_results, img_h, img_w, true);
+    Pnet_Detect(img, boxes);
+    doNms(boxes, 0.7, NmsMode::Union);
+    CandidateArena::cap(boxes, this->max_pnet_candidates, arena.pnet_capped);
+    refine(boxes, img_h, img_w, true);
+    roiFilter(boxes, params);
 
-    std::vector<FaceInfo> onet_results = Onet_Detect(img, rnet_results);
-    refine(onet_results, img_h, img_w, false);
-    doNms(onet_results, 0.7, "min");
+    Rnet_Detect(img, boxes);
+    doNms(boxes, 0.7, NmsMode::Union);
+    CandidateArena::cap(boxes, this->max_rnet_candidates, arena.rnet_capped);
+    refine(boxes, img_h, img_w, true);
 
-    Lnet_Detect(img, onet_results);
+    Onet_Detect(img, boxes);
+    refine(boxes, img_h, img_w, false);
+    doNms(boxes, 0.7, NmsMode::Min);
 
-    return onet_results;
+    if (this->use_lnet)
+        Lnet_Detect(img, boxes);
+
+    return frame.results();
 }
 
-std::vector<FaceInfo> MtcnnDetector::Pnet_Detect(ncnn::Mat img)
+std::vector<FaceInfo> MtcnnDetector::Refresh(const FrameView& frame_img, const std::vector<FaceInfo>& bboxs, bool use_lnet)
 {
+    stat_calls++;
+    FrameView img = downscaleFrame(frame_img, this->detect_scale);
+    int img_w = img.w;
+    int img_h = img.h;
+
     std::vector<FaceInfo> results;
+    {
+        FrameScope frame(*this, frameDeadline());
+        std::vector<FaceInfo>& boxes = frame.arena.boxes;
+        boxes.assign(bboxs.begin(), bboxs.end());
+        frame.arena.copied_bytes += bboxs.size() * sizeof(FaceInfo);
+        if (img.w != frame_img.w || img.h != frame_img.h)
+            scaleFaces(boxes, (float)img.w / frame_img.w, (float)img.h / frame_img.h);
+
+        Onet_Detect(img, boxes);
+        refine(boxes, img_h, img_w, false);
+        doNms(boxes, 0.7, NmsMode::Min);
+
+        if (use_lnet)
+            Lnet_Detect(img, boxes);
+
+        results = frame.results();
+    }
+    restoreScale(results, frame_img, img);
+    return results;
+}
+
+std::vector<FaceInfo> MtcnnDetector::DetectLargest(const FrameView& img, int min_face_size, float min_score)
+{
+    stat_calls++;
+    FrameView view = downscaleFrame(img, this->detect_scale);
+    std::vector<FaceInfo> results = detectLargestFrame(view, (int)round(min_face_size * (float)view.w / img.w), min_score);
+    restoreScale(results, img, view);
+    return results;
+}
+
+std::vector<FaceInfo> MtcnnDetector::detectLargestFrame(const FrameView& img, int min_face_size, float min_score)
+{
     int img_w = img.w;
     int img_h = img.h;
+
+    FrameScope frame(*this, frameDeadline());
+    CandidateArena& arena = frame.arena;
+    std::vector<FaceInfo>& boxes = arena.boxes;
+
+    ScalePlan& plan = getScalePlan(img_w, img_h);
+    FaceInfo largest;
+    bool found = false;
+    int largest_size = 0;
+
+    // 尺度由小到大，對應的人臉由大到小
+    for (size_t i = plan.levels.size(); i-- > 0 && !arena.expired(); )
+    {
+        boxes.clear();
+        Pnet_DetectScale(img, plan, i, boxes);
+        if (boxes.empty())
+            continue;
+        doNms(boxes, 0.7, NmsMode::Union);
+        CandidateArena::cap(boxes, this->max_pnet_candidates, arena.pnet_capped);
+        refine(boxes, img_h, img_w, true);
+
+        Rnet_Detect(img, boxes);
+        doNms(boxes, 0.7, NmsMode::Union);
+        CandidateArena::cap(boxes, this->max_rnet_candidates, arena.rnet_capped);
+        refine(boxes, img_h, img_w, true);
+
+        Onet_Detect(img, boxes);
+        refine(boxes, img_h, img_w, false);
+        doNms(boxes, 0.7, NmsMode::Min);
+
+        bool qualified = false;
+        for (auto face = boxes.begin(); face != boxes.end(); face++)
+        {
+            int w = face->x[1] - face->x[0] + 1;
+            int h = face->y[1] - face->y[0] + 1;
+            int size = w > h ? w : h;
+            if (size > largest_size)
+            {
+                largest = *face;
+                largest_size = size;
+                found = true;
+            }
+            if (size >= min_face_size && face->score >= min_score)
+                qualified = true;
+        }
+        if (qualified)
+            break;
+    }
+
+    boxes.clear();
+    if (found)
+    {
+        boxes.push_back(largest);
+        if (this->use_lnet)
+            Lnet_Detect(img, boxes);
+    }
+    return frame.results();
+}
+
+static std::vector<int> tileStarts(int length, int tile_size, int stride)
+{
+    std::vector<int> starts;
+    for (int start = 0; ; start += stride)
+    {
+        if (start + tile_size >= length)
+        {
+            starts.push_back(length > tile_size ? length - tile_size : 0);
+            break;
+        }
+        starts.push_back(start);
+    }
+    return starts;
+}
+
+std::vector<FaceInfo> MtcnnDetector::DetectTiled(const FrameView& frame_img, int tile_size, int overlap, int num_threads)
+{
+    // 整幀只算一次呼叫，各區塊的統計累加到這一次
+    stat_calls++;
+    // 區塊尺寸以縮小後的影格計算，重疊寬度 (最大人臉) 跟著縮小
+    FrameView img = downscaleFrame(frame_img, this->detect_scale);
+    overlap = (int)round(overlap * (float)img.w / frame_img.w);
+
+    // 只切分偵測區域的外接矩形
+    cv::Rect area = roi.bounds(img.w, img.h);
+    int img_w = area.width;
+    int img_h = area.height;
+
+    if (img_w <= tile_size && img_h <= tile_size)
+    {
+        std::vector<FaceInfo> results = detectFrame(img);
+        restoreScale(results, frame_img, img);
+        return results;
+    }
+
+    // 所有區塊共用同一個截止時間與人臉大小範圍，對整幀生效
+    FrameParams params = frameParams(img);
+
+    // 重疊寬度等於要找的最大人臉，確保每張臉都完整落在某個區塊內
+    if (overlap >= tile_size)
+        overlap = tile_size / 2;
+    std::vector<int> xs = tileStarts(img_w, tile_size, tile_size - overlap);
+    std::vector<int> ys = tileStarts(img_h, tile_size, tile_size - overlap);
+    int num_tiles = (int)(xs.size() * ys.size());
+
+#if _OPENMP
+    if (num_threads <= 0)
+        num_threads = omp_get_max_threads();
+#endif
+
+    std::vector<std::vector<FaceInfo> > tile_results(num_tiles);
+
+    #pragma omp parallel for schedule(dynamic) num_threads(num_threads > 0 ? num_threads : 1)
+    for (int t = 0; t < num_tiles; t++)
+    {
+        int x = xs[t % xs.size()];
+        int y = ys[t / xs.size()];
+        int w = std::min(tile_size, img_w - x);
+        int h = std::min(tile_size, img_h - y);
+
+        // 區塊只是原圖的子視圖，不複製像素
+        FrameParams tile_params = params;
+        tile_params.offset_x = area.x + x;
+        tile_params.offset_y = area.y + y;
+        std::vector<FaceInfo> faces = Detect(img.roi(area.x + x, area.y + y, w, h), tile_params);
+        offsetFaces(faces, area.x + x, area.y + y);
+        tile_results[t].swap(faces);
+    }
+
+    std::vector<FaceInfo> results;
+    for (auto it = tile_results.begin(); it != tile_results.end(); it++)
+        results.insert(results.end(), it->begin(), it->end());
+    doNms(results, 0.7, NmsMode::Min);
+    if (this->adaptive_scales)
+        size_prior.observe(results);
+    restoreScale(results, frame_img, img);
+    return results;
+}
+
+std::vector<FaceInfo> MtcnnDetector::DetectRegions(const FrameView& frame_img, const std::vector<cv::Rect>& regions)
+{
+    stat_calls++;
+    FrameView img = downscaleFrame(frame_img, this->detect_scale);
+    float sx = (float)img.w / frame_img.w;
+    float sy = (float)img.h / frame_img.h;
+    FrameParams params = frameParams(img);
+    cv::Rect area = roi.bounds(img.w, img.h);
+
+    std::vector<FaceInfo> results;
+    for (auto it = regions.begin(); it != regions.end(); it++)
+    {
+        // 區域換算到縮小影格，向外取整以免切掉邊緣
+        int x0 = (int)floor(it->x * sx), y0 = (int)floor(it->y * sy);
+        int x1 = (int)ceil((it->x + it->width) * sx), y1 = (int)ceil((it->y + it->height) * sy);
+        cv::Rect r = cv::Rect(x0, y0, x1 - x0, y1 - y0) & area;
+        if (r.area() <= 0)
+            continue;
+        FrameParams region_params = params;
+        region_params.offset_x = r.x;
+        region_params.offset_y = r.y;
+        std::vector<FaceInfo> faces = Detect(img.roi(r.x, r.y, r.width, r.height), region_params);
+        offsetFaces(faces, r.x, r.y);
+        results.insert(results.end(), faces.begin(), faces.end());
+    }
+    if (regions.size() > 1)
+        doNms(results, 0.7, NmsMode::Min);
+    if (this->adaptive_scales)
+        size_prior.observe(results);
+    restoreScale(results, frame_img, img);
+    return results;
+}
+
+static const size_t kMaxScalePlans = 4;
+
+ScalePlan& MtcnnDetector::getScalePlan(int img_w, int img_h)
+{
+    CandidateArena& arena = candidateArena();
+    arena.plan_clock++;
+    for (auto it = arena.plans.begin(); it != arena.plans.end(); it++)
+    {
+        if (it->matches(img_w, img_h, this->minsize, this->factor, this->max_face_size))
+        {
+            it->last_used = arena.plan_clock;
+            return *it;
+        }
+    }
+
+    // 未命中時覆寫最久沒用的規劃
+    if (arena.plans.size() < kMaxScalePlans)
+        arena.plans.emplace_back();
+    ScalePlan* plan = &arena.plans[0];
+    for (auto it = arena.plans.begin(); it != arena.plans.end(); it++)
+        if (it->last_used < plan->last_used)
+            plan = &*it;
+
+    plan->img_w = img_w;
+    plan->img_h = img_h;
+    plan->minsize = this->minsize;
+    plan->factor = this->factor;
+    plan->max_face_size = this->max_face_size;
+    plan->last_used = arena.plan_clock;
+    plan->levels.clear();
+
     float minl = img_w < img_h ? img_w : img_h;
     double scale = 12.0 / this->minsize;
     minl *= scale;
-    std::vector<double> scales;
+    plan->max_pixels = plan->max_input = 0;
     while (minl > 12)
     {
-        scales.push_back(scale);
+        // 該層可偵測的人臉約為 12 / scale，前一層已涵蓋 max_face_size 時捨棄其餘較粗的層
+        if (this->max_face_size > 0 && 12.0 / scale * this->factor >= this->max_face_size)
+            break;
+        ScaleLevel level;
+        level.scale = scale;
+        level.hs = (int) ceil(img_h * scale);
+        level.ws = (int) ceil(img_w * scale);
+        size_t cstep = ncnn::alignSize((size_t)level.ws * level.hs * sizeof(float), 16) / sizeof(float);
+        plan->max_pixels = std::max(plan->max_pixels, (size_t)level.ws * level.hs * 3);
+        plan->max_input = std::max(plan->max_input, cstep * 3);
+        plan->levels.push_back(level);
         minl *= this->factor;
         scale *= this->factor;
     }
-    for (auto it = scales.begin(); it != scales.end(); it++)
+    // 共用緩衝區只會增長，穩定後不再配置
+    if (arena.pyramid_pixels.size() < plan->max_pixels)
+        arena.pyramid_pixels.resize(plan->max_pixels);
+    if (arena.pyramid_input.size() < plan->max_input)
+        arena.pyramid_input.resize(plan->max_input);
+    stat_plan_builds++;
+    return *plan;
+}
+
+void MtcnnDetector::Pnet_Detect(const FrameView& img, std::vector<FaceInfo>& boxes)
+{
+    // 超過時間上限時略過剩餘的尺度
+    CandidateArena& arena = candidateArena();
+    ScalePlan& plan = getScalePlan(img.w, img.h);
+    for (size_t i = 0; i < plan.levels.size() && !arena.expired(); i++)
     {
-        scale = (double)(*it);
-        int hs = (int) ceil(img_h * scale);
-        int ws = (int) ceil(img_w * scale);
-        ncnn::Mat in = resize(img, ws, hs);
-        in.substract_mean_normalize(this->mean_vals, this->norm_vals);
-        ncnn::Extractor ex = Pnet.create_extractor();
-        ex.set_light_mode(true);
-        ex.input("data", in);
-        ncnn::Mat score;
-        ncnn::Mat location;
-        ex.extract("prob1", score);
-        ex.extract("conv4_2", location);
-        std::vector<FaceInfo> bboxs = generateBbox(score, location, *it, this->threshold[0]);
-        doNms(bboxs, 0.5, "union");
-        results.insert(results.end(), bboxs.begin(), bboxs.end());
+        // 該層找的人臉邊長約在 12 / scale 到下一層的 12 / (scale * factor) 之間，
+        // 與自適應範圍沒有交集就略過
+        float face_min = (float)(12.0 / plan.levels[i].scale);
+        float face_max = face_min / this->factor;
+        if (arena.band_max > 0 && (face_max < arena.band_min || face_min > arena.band_max))
+        {
+            arena.levels_skipped++;
+            continue;
+        }
+        arena.levels_run++;
+        Pnet_DetectScale(img, plan, i, boxes);
     }
-    return results;
 }
 
-std::vector<FaceInfo> MtcnnDetector::Rnet_Detect(ncnn::Mat img, std::vector<FaceInfo> bboxs)
+void MtcnnDetector::Pnet_DetectScale(const FrameView& img, ScalePlan& plan, size_t level, std::vector<FaceInfo>& boxes)
 {
-    std::vector<FaceInfo> results;
-
-    int img_w = img.w;
-    int img_h = img.h;
+    CandidateArena& arena = candidateArena();
+    BoxArray& candidates = arena.scale_boxes;
+    std::vector<unsigned char>& suppressed = arena.scale_suppressed;
+    ScaleLevel& l = plan.levels[level];
+    double scale = l.scale;
+    int ws = l.ws;
+    int hs = l.hs;
+
+    // 縮放到共用像素緩衝區，再一次完成 BGR 分離與正規化寫入共用的輸入張量
+    ncnn::Mat in(ws, hs, 3, arena.pyramid_input.data());
+    const unsigned char* pixels = img.data;
+    int stride = img.stride;
+    if (ws != img.w || hs != img.h)
+    {
+        ncnn::resize_bilinear_c3(img.data, img.w, img.h, img.stride, arena.pyramid_pixels.data(), ws, hs, ws * 3);
+        pixels = arena.pyramid_pixels.data();
+        stride = ws * 3;
+    }
+    for (int c = 0; c < 3; c++)
+    {
+        float* dst = in.channel(c);
+        const float mean = this->mean_vals[c];
+        const float norm = this->norm_vals[c];
+        for (int y = 0; y < hs; y++)
+        {
+            const unsigned char* row = pixels + (size_t)y * stride + c;
+            for (int x = 0; x < ws; x++)
+                dst[x] = (row[x * 3] - mean) * norm;
+            dst += ws;
+        }
+    }
+    ncnn::Extractor ex = getNet(0).create_extractor();
+    useWorkerAllocators(ex);
+    if (input_observer) input_observer(0, in);
+    ex.input("data", in);
+    ncnn::Mat score;
+    ncnn::Mat location;
+    ex.extract("prob1", score);
+    ex.extract("conv4_2", location);
+    generateBbox(score, location, scale, this->threshold[0], candidates);
+    nmsSoA(candidates, 0.5, NmsMode::Union, suppressed, this->nms_grid);
+    // 本尺度存活的框直接附加到整幀的候選框陣列
+    size_t before = boxes.size();
+    for (size_t i = 0; i < candidates.size(); i++)
+        if (!suppressed[i])
+            boxes.push_back(candidates.get(i));
+    arena.copied_bytes += (boxes.size() - before) * sizeof(FaceInfo);
+}
 
-    for (auto it = bboxs.begin(); it != bboxs.end(); it++)
+void MtcnnDetector::Rnet_Detect(const FrameView& img, std::vector<FaceInfo>& bboxs)
+{
+    // 就地篩選：通過的框往前搬，只有位置改變時才複製。
+    // 依分數由高到低處理，超過時間上限時只捨棄前 kMinSurvivors 個之後、分數較低的框
+    CandidateArena& arena = candidateArena();
+    arena.sortByScore(bboxs);
+    size_t kept = 0;
+    for (auto it = bboxs.begin(); it != bboxs.end() && !arena.stopAt((size_t)(it - bboxs.begin())); it++)
     {
-        ncnn::Mat img_t;
-        copy_cut_border(img, img_t, it->y[0], img_h - it->y[1], it->x[0], img_w - it->x[1]);
-        ncnn::Mat in = resize(img_t, 24, 24);
+        ncnn::Mat& in = arena.rnet_input;
+        cropResize(img, it->x[0], it->y[0], it->x[1], it->y[1], 24, 24, in);
         in.substract_mean_normalize(this->mean_vals, this->norm_vals);
-        ncnn::Extractor ex = Rnet.create_extractor();
-        ex.set_light_mode(true);
+        ncnn::Extractor ex = getNet(1).create_extractor();
+        useWorkerAllocators(ex);
+        if (input_observer) input_observer(1, in);
         ex.input("data", in);
         ncnn::Mat score, bbox;
         ex.extract("prob1", score);
@@ -124,27 +771,32 @@ std::vector<FaceInfo> MtcnnDetector::Rnet_Detect(ncnn::Mat img, std::vector<Face
                 it->regreCoord[c] = (float)bbox[c];
             }
             it->score = (float)score[1];
-            results.push_back(*it);
+            if (&bboxs[kept] != &*it)
+            {
+                bboxs[kept] = *it;
+                arena.copied_bytes += sizeof(FaceInfo);
+            }
+            kept++;
         }
     }
-    return results;
+    bboxs.resize(kept);
 }
 
-std::vector<FaceInfo> MtcnnDetector::Onet_Detect(ncnn::Mat img, std::vector<FaceInfo> bboxs)
+void MtcnnDetector::Onet_Detect(const FrameView& img, std::vector<FaceInfo>& bboxs)
 {
-    std::vector<FaceInfo> results;
-
-    int img_w = img.w;
-    int img_h = img.h;
-
-    for (auto it = bboxs.begin(); it != bboxs.end(); it++)
+    // 就地篩選：通過的框往前搬，只有位置改變時才複製。
+    // 依分數由高到低處理，超過時間上限時只捨棄前 kMinSurvivors 個之後、分數較低的框
+    CandidateArena& arena = candidateArena();
+    arena.sortByScore(bboxs);
+    size_t kept = 0;
+    for (auto it = bboxs.begin(); it != bboxs.end() && !arena.stopAt((size_t)(it - bboxs.begin())); it++)
     {
-        ncnn::Mat img_t;
-        copy_cut_border(img, img_t, it->y[0], img_h - it->y[1], it->x[0], img_w - it->x[1]);
-        ncnn::Mat in = resize(img_t, 48, 48);
+        ncnn::Mat& in = arena.onet_input;
+        cropResize(img, it->x[0], it->y[0], it->x[1], it->y[1], 48, 48, in);
         in.substract_mean_normalize(this->mean_vals, this->norm_vals);
-        ncnn::Extractor ex = Onet.create_extractor();
-        ex.set_light_mode(true);
+        ncnn::Extractor ex = getNet(2).create_extractor();
+        useWorkerAllocators(ex);
+        if (input_observer) input_observer(2, in);
         ex.input("data", in);
         ncnn::Mat score, bbox, point;
         ex.extract("prob1", score);
@@ -162,17 +814,48 @@ std::vector<FaceInfo> MtcnnDetector::Onet_Detect(ncnn::Mat img, std::vector<Face
                 it->landmark[2 * p + 1] = it->y[0] + (it->y[1] - it->y[0]) * point[p + 5];
             }
             it->score = (float)score[1];
-            results.push_back(*it);
+            if (&bboxs[kept] != &*it)
+            {
+                bboxs[kept] = *it;
+                arena.copied_bytes += sizeof(FaceInfo);
+            }
+            kept++;
         }
     }
-    return results;
+    bboxs.resize(kept);
 }
 
-void MtcnnDetector::Lnet_Detect(ncnn::Mat img, std::vector<FaceInfo> &bboxes)
+void MtcnnDetector::roiFilter(std::vector<FaceInfo>& bboxs, const FrameParams& params)
 {
-    int img_w = img.w;
-    int img_h = img.h;
+    if (roi.empty())
+        return;
+    CandidateArena& arena = candidateArena();
+    float inv_w = 1.0f / params.frame_w;
+    float inv_h = 1.0f / params.frame_h;
+    size_t kept = 0;
+    for (size_t i = 0; i < bboxs.size(); i++)
+    {
+        float cx = (bboxs[i].x[0] + bboxs[i].x[1]) * 0.5f + params.offset_x;
+        float cy = (bboxs[i].y[0] + bboxs[i].y[1]) * 0.5f + params.offset_y;
+        if (!roi.contains(cx * inv_w, cy * inv_h))
+            continue;
+        if (kept != i)
+        {
+            bboxs[kept] = bboxs[i];
+            arena.copied_bytes += sizeof(FaceInfo);
+        }
+        kept++;
+    }
+    arena.roi_rejected += bboxs.size() - kept;
+    bboxs.resize(kept);
+}
 
+void MtcnnDetector::Lnet_Detect(const FrameView& img, std::vector<FaceInfo> &bboxes)
+{
+    // Lnet 只是精修關鍵點，超過時間上限時保留 Onet 的結果
+    CandidateArena& arena = candidateArena();
+    if (arena.expired())
+        return;
     for (auto it = bboxes.begin(); it != bboxes.end(); it++)
     {
         int w = it->x[1] - it->x[0] + 1;
@@ -182,22 +865,23 @@ void MtcnnDetector::Lnet_Detect(ncnn::Mat img, std::vector<FaceInfo> &bboxes)
         if (m % 2 == 1) m++;
         m /= 2;
 
-        ncnn::Mat in(24, 24, 15);
+        ncnn::Mat& in = arena.lnet_input;
+        ensureMat(in, 24, 24, 15);
 
         for (int i = 0; i < 5; i++)
         {
             int px = it->landmark[2 * i];
             int py = it->landmark[2 * i + 1];
-            ncnn::Mat cut;
-            copy_cut_border(img, cut, py - m, img_h - py - m, px - m, img_w - px - m);
-            ncnn::Mat resized = resize(cut, 24, 24);
+            ncnn::Mat& resized = arena.lnet_patch;
+            cropResize(img, px - m, py - m, px + m, py + m, 24, 24, resized);
             resized.substract_mean_normalize(this->mean_vals, this->norm_vals);
             for (int j = 0; j < 3; j++)
                 memcpy(in.channel(3 * i + j), resized.channel(j), 24 * 24 * sizeof(float));
         }
 
-        ncnn::Extractor ex = Lnet.create_extractor();
-        ex.set_light_mode(true);
+        ncnn::Extractor ex = getNet(3).create_extractor();
+        useWorkerAllocators(ex);
+        if (input_observer) input_observer(3, in);
         ex.input("data", in);
         ncnn::Mat out1, out2, out3, out4, out5;
 
@@ -231,81 +915,69 @@ void MtcnnDetector::Lnet_Detect(ncnn::Mat img, std::vector<FaceInfo> &bboxes)
     }
 }
 
-std::vector<FaceInfo> MtcnnDetector::generateBbox(ncnn::Mat score, ncnn::Mat loc, float scale, float thresh)
+void MtcnnDetector::generateBbox(const ncnn::Mat& score, const ncnn::Mat& loc, float scale, float thresh, BoxArray& boxes)
 {
     int stride = 2;
     int cellsize = 12;
-    float *p = score.channel(1);
     float inv_scale = 1.0f / scale;
-    std::vector<FaceInfo> results;
-    for (int row = 0; row < score.h; row++)
+    int size = score.w * score.h;
+
+    // 先以向量化掃描挑出超過閾值的位置，只為這些位置建立候選框
+    std::vector<int>& indices = candidateArena().indices;
+    if ((int)indices.size() < size)
+        indices.resize(size);
+    int count = thresholdIndices(score.channel(1), size, thresh, indices.data());
+
+    const float* p = score.channel(1);
+    const float* reg[4] = {loc.channel(0), loc.channel(1), loc.channel(2), loc.channel(3)};
+    boxes.resize(count);
+    for (int k = 0; k < count; k++)
     {
-        for (int col = 0; col < score.w; col++)
-        {
-            if (*p > thresh)
-            {
-                FaceInfo box;
-                box.score = *p;
-                box.x[0] = round((stride * col + 1) * inv_scale);
-                box.y[0] = round((stride * row + 1) * inv_scale);
-                box.x[1] = round((stride * col + 1 + cellsize) * inv_scale);
-                box.y[1] = round((stride * row + 1 + cellsize) * inv_scale);
-                box.area = (box.x[1] - box.x[0]) * (box.y[1] - box.y[0]);
-                int index = row * score.w + col;
-                for (int c = 0; c < 4; c++)
-                    box.regreCoord[c] = loc.channel(c)[index];
-                results.push_back(box); 
-            }
-            p++;        
-        }
+        int index = indices[k];
+        int row = index / score.w;
+        int col = index - row * score.w;
+        float x0 = round((stride * col + 1) * inv_scale);
+        float y0 = round((stride * row + 1) * inv_scale);
+        float x1 = round((stride * col + 1 + cellsize) * inv_scale);
+        float y1 = round((stride * row + 1 + cellsize) * inv_scale);
+        boxes.x0[k] = x0;
+        boxes.y0[k] = y0;
+        boxes.x1[k] = x1;
+        boxes.y1[k] = y1;
+        boxes.score[k] = p[index];
+        boxes.area[k] = (x1 - x0) * (y1 - y0);
+        for (int c = 0; c < 4; c++)
+            boxes.reg[c][k] = reg[c][index];
     }
-    return results;
 }
 
-bool cmpScore(FaceInfo x, FaceInfo y)
-{
-    if (x.score > y.score)
-        return true;
-    else
-        return false;
-}
-
-float calcIOU(FaceInfo box1, FaceInfo box2, std::string mode)
-{
-    int maxX = std::max(box1.x[0], box2.x[0]);
-    int maxY = std::max(box1.y[0], box2.y[0]);
-    int minX = std::min(box1.x[1], box2.x[1]);
-    int minY = std::min(box1.y[1], box2.y[1]);
-    int width = ((minX - maxX + 1) > 0) ? (minX - maxX + 1) : 0;
-    int height = ((minY - maxY + 1) > 0) ? (minY - maxY + 1) : 0;
-    int inter = width * height;
-    if (!mode.compare("union"))
-        return float(inter) / (box1.area + box2.area - float(inter));
-    else if (!mode.compare("min"))
-        return float(inter) / (box1.area < box2.area ? box1.area : box2.area);
-    else
-        return 0;
-}
-
-void MtcnnDetector::doNms(std::vector<FaceInfo> &bboxs, float nms_thresh, std::string mode)
+void MtcnnDetector::doNms(std::vector<FaceInfo> &bboxs, float nms_thresh, NmsMode mode)
 {
     if (bboxs.empty())
         return;
-    sort(bboxs.begin(), bboxs.end(), cmpScore);
-    for (int i = 0; i < bboxs.size(); i++)
-        if (bboxs[i].score > 0)
-            for (int j = i + 1; j < bboxs.size(); j++)
-                if (bboxs[j].score > 0)
-                {
-                    float iou = calcIOU(bboxs[i], bboxs[j], mode);
-                    if (iou > nms_thresh)
-                        bboxs[j].score = 0;
-                }
-    for (auto it = bboxs.begin(); it != bboxs.end();)
-        if ((*it).score == 0)
-            bboxs.erase(it);
-        else
-            it++;
+    CandidateArena& arena = candidateArena();
+    BoxArray& nms_boxes = arena.nms_boxes;
+    nms_boxes.clear();
+    nms_boxes.reserve(bboxs.size());
+    for (auto it = bboxs.begin(); it != bboxs.end(); it++)
+        nms_boxes.push_back(*it);
+    nmsSoA(nms_boxes, nms_thresh, mode, arena.nms_suppressed, this->nms_grid);
+
+    // 存活框以索引依分數排序，再一次搬到另一塊緩衝區後交換，不逐次複製整個 FaceInfo
+    std::vector<int>& order = arena.order;
+    order.clear();
+    for (int i = 0; i < (int)bboxs.size(); i++)
+        if (!arena.nms_suppressed[i])
+            order.push_back(i);
+    std::sort(order.begin(), order.end(),
+              [&nms_boxes](int a, int b) { return nms_boxes.score[a] > nms_boxes.score[b]; });
+
+    std::vector<FaceInfo>& sorted = arena.sorted;
+    sorted.clear();
+    for (auto it = order.begin(); it != order.end(); it++)
+        sorted.push_back(bboxs[*it]);
+    arena.copied_bytes += order.size() * sizeof(FaceInfo);
+    bboxs.swap(sorted);
 }
 
 void MtcnnDetector::refine(std::vector<FaceInfo> &bboxs, int height, int width, bool flag)
@@ -6,30 +6,128 @@
 #include <string>
 #include <cstring>
 #include <algorithm>
+#include <functional>
+#include <mutex>
+#include <atomic>
+#include <chrono>
 #include "net.h"
 #include "base.h"
+#include "nms.h"
+#include "face_size_prior.h"
+#include "roi_mask.h"
+
+// 偵測器累計統計：候選框緩衝區的 heap 配置次數與 FaceInfo 複製量
+struct DetectorStats {
+    size_t calls = 0;          // 公開偵測函式的呼叫次數，分塊與多區域偵測整幀只算一次
+    size_t allocations = 0;    // 候選框緩衝區增長與輸出結果的配置次數
+    size_t copied_bytes = 0;   // 各階段間複製 FaceInfo 的位元組數
+    size_t pnet_capped = 0;    // Pnet 候選框超過上限而被截斷的次數
+    size_t rnet_capped = 0;    // Rnet 候選框超過上限而被截斷的次數
+    size_t budget_exceeded = 0; // 超過單幀時間上限而提前結束的次數
+    size_t budget_empty = 0;   // 其中提前結束且沒有偵測到任何人臉的次數
+    size_t plan_builds = 0;    // 重新計算尺度規劃的次數
+    size_t pnet_levels = 0;    // 實際執行的 Pnet 金字塔層數
+    size_t pnet_levels_skipped = 0;  // 自適應尺寸範圍外而略過的層數
+    size_t roi_rejected = 0;   // 中心落在偵測區域外、未送進 Rnet 的候選框數
+
+    double allocationsPerCall() const { return calls ? (double)allocations / calls : 0.0; }
+    double copiedBytesPerCall() const { return calls ? (double)copied_bytes / calls : 0.0; }
+};
+
+struct ScalePlan;
 
 class MtcnnDetector {
 public:
+    // 建構時只記錄模型路徑，各網路在第一次使用時才載入
     MtcnnDetector(std::string model_folder = "");
     ~MtcnnDetector();
-    std::vector<FaceInfo> Detect(ncnn::Mat img);
+    // 平行預先載入尚未載入的網路，避免第一幀才逐一載入；use_lnet 為 false 時不載入 Lnet。
+    // 任一網路載入失敗時回傳 false
+    bool preload(bool use_lnet = true);
+    // 完整偵測 (Detect / DetectLargest / DetectTiled) 是否執行 Lnet
+    bool usesLnet() const { return use_lnet; }
+    std::vector<FaceInfo> Detect(const FrameView& img);
+    // 只以 Onet (與可選的 Lnet) 重新評估給定的框，供追蹤模式使用
+    std::vector<FaceInfo> Refresh(const FrameView& img, const std::vector<FaceInfo>& bboxs, bool use_lnet = true);
+    // 由粗到細逐一尺度偵測，找到夠大且分數夠高的人臉就提前結束，只回傳最大的一張
+    std::vector<FaceInfo> DetectLargest(const FrameView& img, int min_face_size, float min_score);
+    // 將大圖切成重疊的區塊平行偵測，再以全域 NMS 合併接縫處的重複人臉
+    std::vector<FaceInfo> DetectTiled(const FrameView& img, int tile_size, int overlap, int num_threads = 0);
+    // 設定偵測區域：Pnet 只處理遮罩的外接矩形，中心落在遮罩外的候選框在 Rnet 前捨棄
+    void setRoi(const RoiMask& roi) { this->roi = roi; }
+    // 只在給定的區域 (原圖像素) 內偵測，例如變動偵測找到的區塊，結果以全域 NMS 合併
+    std::vector<FaceInfo> DetectRegions(const FrameView& img, const std::vector<cv::Rect>& regions);
+    // 可偵測的最小人臉邊長 (原圖像素)，縮小偵測時按比例放大
+    int getMinSize() const { return (int)ceil(minsize / detect_scale); }
+    DetectorStats getStats() const;
+    void resetStats();
+
+    // 每次前向前以網路編號 (0~3 對應 det1~det4) 回呼輸入，供 int8 校正收集資料
+    std::function<void(int, const ncnn::Mat&)> input_observer;
 private:
     float minsize = 20;
     float threshold[3] = {0.6f, 0.7f, 0.8f};
     float factor = 0.709f;
+    bool nms_grid = true;
+    int max_pnet_candidates = 0;
+    int max_rnet_candidates = 0;
+    double time_budget_ms = 0;
+    int max_face_size = 0;
+    bool adaptive_scales = false;
+    float detect_scale = 1.0f;
+    bool use_lnet = true;
+    FaceSizePrior size_prior;
+    RoiMask roi;
     const float mean_vals[3] = {127.5f, 127.5f, 127.5f};
     const float norm_vals[3] = {0.0078125f, 0.0078125f, 0.0078125f};
     ncnn::Net Pnet;
     ncnn::Net Rnet;
     ncnn::Net Onet;
     ncnn::Net Lnet;
-    std::vector<FaceInfo> Pnet_Detect(ncnn::Mat img);
-    std::vector<FaceInfo> Rnet_Detect(ncnn::Mat img, std::vector<FaceInfo> bboxs);
-    std::vector<FaceInfo> Onet_Detect(ncnn::Mat img, std::vector<FaceInfo> bboxs);
-    void Lnet_Detect(ncnn::Mat img, std::vector<FaceInfo> &bboxs);
-    std::vector<FaceInfo> generateBbox(ncnn::Mat score, ncnn::Mat loc, float scale, float thresh);
-    void doNms(std::vector<FaceInfo> &bboxs, float nms_thresh, std::string mode);
+    std::vector<std::string> param_files;
+    std::vector<std::string> bin_files;
+    std::once_flag load_flags[4];
+    bool loaded[4] = {false, false, false, false};  // 由 load_flags 保護，載入後唯讀
+    std::atomic<size_t> stat_calls{0};
+    std::atomic<size_t> stat_allocations{0};
+    std::atomic<size_t> stat_copied_bytes{0};
+    std::atomic<size_t> stat_pnet_capped{0};
+    std::atomic<size_t> stat_rnet_capped{0};
+    std::atomic<size_t> stat_budget_exceeded{0};
+    std::atomic<size_t> stat_budget_empty{0};
+    std::atomic<size_t> stat_plan_builds{0};
+    std::atomic<size_t> stat_pnet_levels{0};
+    std::atomic<size_t> stat_pnet_levels_skipped{0};
+    std::atomic<size_t> stat_roi_rejected{0};
+    class FrameScope;
+    bool ensureLoaded(int k);      // 未載入時先載入，回傳是否載入成功
+    ncnn::Net& getNet(int k);      // 0~3 對應 Pnet~Lnet，未載入時先載入，載入失敗時拋出 runtime_error
+    // 依 time_budget_ms 計算本幀的截止時間，未設定時為 time_point::max()
+    std::chrono::steady_clock::time_point frameDeadline() const;
+    // 單幀偵測參數，分塊偵測時各區塊共用同一份 (只有位移不同)
+    struct FrameParams {
+        std::chrono::steady_clock::time_point deadline;
+        float band_min = 0, band_max = 0;   // Pnet 要涵蓋的人臉邊長範圍，0 表示全部尺度
+        int offset_x = 0, offset_y = 0;     // img 左上角在完整影格中的位置
+        int frame_w = 0, frame_h = 0;       // 完整影格尺寸，用來換算遮罩的正規化座標
+    };
+    FrameParams frameParams(const FrameView& img);
+    // 在已縮小的偵測影格上執行，座標皆為該影格的像素
+    std::vector<FaceInfo> detectFrame(const FrameView& img);
+    std::vector<FaceInfo> detectLargestFrame(const FrameView& img, int min_face_size, float min_score);
+    std::vector<FaceInfo> Detect(const FrameView& img, const FrameParams& params);
+    // 捨棄中心落在偵測區域外的候選框
+    void roiFilter(std::vector<FaceInfo>& bboxs, const FrameParams& params);
+    // 取得目前執行緒對此尺寸與參數的尺度規劃，沒有時才計算並配置各層緩衝區
+    ScalePlan& getScalePlan(int img_w, int img_h);
+    // 各階段就地處理同一個候選框陣列：Pnet 附加，Rnet/Onet 篩掉未通過的框
+    void Pnet_Detect(const FrameView& img, std::vector<FaceInfo>& bboxs);
+    void Pnet_DetectScale(const FrameView& img, ScalePlan& plan, size_t level, std::vector<FaceInfo>& bboxs);
+    void Rnet_Detect(const FrameView& img, std::vector<FaceInfo>& bboxs);
+    void Onet_Detect(const FrameView& img, std::vector<FaceInfo>& bboxs);
+    void Lnet_Detect(const FrameView& img, std::vector<FaceInfo> &bboxs);
+    void generateBbox(const ncnn::Mat& score, const ncnn::Mat& loc, float scale, float thresh, BoxArray& boxes);
+    void doNms(std::vector<FaceInfo> &bboxs, float nms_thresh, NmsMode mode);
     void refine(std::vector<FaceInfo> &bboxs, int height, int width, bool flag = false);
 };
 
@@ -0,0 +1,313 @@
+#include "nms.h"
+#include <algorithm>
+#include <cmath>
+
+#if __SSE2__
+#include <emmintrin.h>
+#endif
+#if __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+void BoxArray::clear()
+{
+    x0.clear(); y0.clear(); x1.clear(); y1.clear();
+    score.clear();
+    area.clear();
+    for (int c = 0; c < 4; c++)
+        reg[c].clear();
+}
+
+void BoxArray::reserve(size_t n)
+{
+    x0.reserve(n); y0.reserve(n); x1.reserve(n); y1.reserve(n);
+    score.reserve(n);
+    area.reserve(n);
+    for (int c = 0; c < 4; c++)
+        reg[c].reserve(n);
+}
+
+void BoxArray::resize(size_t n)
+{
+    x0.resize(n); y0.resize(n); x1.resize(n); y1.resize(n);
+    score.resize(n);
+    area.resize(n);
+    for (int c = 0; c < 4; c++)
+        reg[c].resize(n);
+}
+
+void BoxArray::push_back(const FaceInfo& info)
+{
+    x0.push_back(info.x[0]);
+    y0.push_back(info.y[0]);
+    x1.push_back(info.x[1]);
+    y1.push_back(info.y[1]);
+    score.push_back(info.score);
+    area.push_back(info.area);
+    for (int c = 0; c < 4; c++)
+        reg[c].push_back(info.regreCoord[c]);
+}
+
+FaceInfo BoxArray::get(size_t i) const
+{
+    FaceInfo info;
+    info.score = score[i];
+    info.x[0] = (int)x0[i];
+    info.y[0] = (int)y0[i];
+    info.x[1] = (int)x1[i];
+    info.y[1] = (int)y1[i];
+    info.area = area[i];
+    for (int c = 0; c < 4; c++)
+        info.regreCoord[c] = reg[c][i];
+    memset(info.landmark, 0, sizeof(info.landmark));
+    return info;
+}
+
+// 依分數排序後的座標暫存區，每個執行緒各自一份，重複使用避免配置
+struct NmsScratch {
+    std::vector<int> order;
+    std::vector<float> x0, y0, x1, y1, area;
+    std::vector<unsigned char> flag;
+
+    // 網格分桶
+    std::vector<int> cell_of;
+    std::vector<int> cell_start;
+    std::vector<int> cell_items;
+    std::vector<int> cell_fill;
+    std::vector<int> cand;
+    std::vector<float> gx0, gy0, gx1, gy1, garea;
+    std::vector<unsigned char> gflag;
+};
+
+static thread_local NmsScratch scratch;
+
+// 計算 box 與 n 個框的重疊率，超過閾值者在 flag 中標記為抑制
+template<NmsMode mode>
+static void suppressOverlaps(const float* x0, const float* y0, const float* x1, const float* y1,
+                             const float* area, int n, const float* box, float thresh,
+                             unsigned char* flag)
+{
+    int j = 0;
+#if __SSE2__
+    __m128 _bx0 = _mm_set1_ps(box[0]);
+    __m128 _by0 = _mm_set1_ps(box[1]);
+    __m128 _bx1 = _mm_set1_ps(box[2]);
+    __m128 _by1 = _mm_set1_ps(box[3]);
+    __m128 _barea = _mm_set1_ps(box[4]);
+    __m128 _one = _mm_set1_ps(1.f);
+    __m128 _zero = _mm_setzero_ps();
+    __m128 _thresh = _mm_set1_ps(thresh);
+    for (; j + 3 < n; j += 4)
+    {
+        __m128 _w = _mm_sub_ps(_mm_min_ps(_bx1, _mm_loadu_ps(x1 + j)), _mm_max_ps(_bx0, _mm_loadu_ps(x0 + j)));
+        __m128 _h = _mm_sub_ps(_mm_min_ps(_by1, _mm_loadu_ps(y1 + j)), _mm_max_ps(_by0, _mm_loadu_ps(y0 + j)));
+        _w = _mm_max_ps(_mm_add_ps(_w, _one), _zero);
+        _h = _mm_max_ps(_mm_add_ps(_h, _one), _zero);
+        __m128 _inter = _mm_mul_ps(_w, _h);
+        __m128 _area = _mm_loadu_ps(area + j);
+        __m128 _denom;
+        if (mode == NmsMode::Union)
+            _denom = _mm_sub_ps(_mm_add_ps(_barea, _area), _inter);
+        else
+            _denom = _mm_min_ps(_barea, _area);
+        int mask = _mm_movemask_ps(_mm_cmpgt_ps(_mm_div_ps(_inter, _denom), _thresh));
+        flag[j] |= mask & 1;
+        flag[j + 1] |= (mask >> 1) & 1;
+        flag[j + 2] |= (mask >> 2) & 1;
+        flag[j + 3] |= (mask >> 3) & 1;
+    }
+#elif __ARM_NEON && __aarch64__
+    float32x4_t _bx0 = vdupq_n_f32(box[0]);
+    float32x4_t _by0 = vdupq_n_f32(box[1]);
+    float32x4_t _bx1 = vdupq_n_f32(box[2]);
+    float32x4_t _by1 = vdupq_n_f32(box[3]);
+    float32x4_t _barea = vdupq_n_f32(box[4]);
+    float32x4_t _one = vdupq_n_f32(1.f);
+    float32x4_t _zero = vdupq_n_f32(0.f);
+    float32x4_t _thresh = vdupq_n_f32(thresh);
+    for (; j + 3 < n; j += 4)
+    {
+        float32x4_t _w = vsubq_f32(vminq_f32(_bx1, vld1q_f32(x1 + j)), vmaxq_f32(_bx0, vld1q_f32(x0 + j)));
+        float32x4_t _h = vsubq_f32(vminq_f32(_by1, vld1q_f32(y1 + j)), vmaxq_f32(_by0, vld1q_f32(y0 + j)));
+        _w = vmaxq_f32(vaddq_f32(_w, _one), _zero);
+        _h = vmaxq_f32(vaddq_f32(_h, _one), _zero);
+        float32x4_t _inter = vmulq_f32(_w, _h);
+        float32x4_t _area = vld1q_f32(area + j);
+        float32x4_t _denom;
+        if (mode == NmsMode::Union)
+            _denom = vsubq_f32(vaddq_f32(_barea, _area), _inter);
+        else
+            _denom = vminq_f32(_barea, _area);
+        uint32x4_t _mask = vcgtq_f32(vdivq_f32(_inter, _denom), _thresh);
+        flag[j] |= vgetq_lane_u32(_mask, 0) & 1;
+        flag[j + 1] |= vgetq_lane_u32(_mask, 1) & 1;
+        flag[j + 2] |= vgetq_lane_u32(_mask, 2) & 1;
+        flag[j + 3] |= vgetq_lane_u32(_mask, 3) & 1;
+    }
+#endif
+    // 其他架構 (包含 RISC-V) 沒有向量版本，全部走以下純量迴圈
+    for (; j < n; j++)
+    {
+        float w = std::max(std::min(box[2], x1[j]) - std::max(box[0], x0[j]) + 1.f, 0.f);
+        float h = std::max(std::min(box[3], y1[j]) - std::max(box[1], y0[j]) + 1.f, 0.f);
+        float inter = w * h;
+        float denom = mode == NmsMode::Union ? box[4] + area[j] - inter : std::min(box[4], area[j]);
+        if (inter / denom > thresh)
+            flag[j] = 1;
+    }
+}
+
+static void suppressOverlaps(NmsMode mode, const float* x0, const float* y0, const float* x1, const float* y1,
+                             const float* area, int n, const float* box, float thresh, unsigned char* flag)
+{
+    if (mode == NmsMode::Union)
+        suppressOverlaps<NmsMode::Union>(x0, y0, x1, y1, area, n, box, thresh, flag);
+    else
+        suppressOverlaps<NmsMode::Min>(x0, y0, x1, y1, area, n, box, thresh, flag);
+}
+
+static void nmsDense(NmsScratch& s, int n, float nms_thresh, NmsMode mode)
+{
+    for (int i = 0; i < n; i++)
+    {
+        if (s.flag[i])
+            continue;
+        float box[5] = {s.x0[i], s.y0[i], s.x1[i], s.y1[i], s.area[i]};
+        int m = n - i - 1;
+        suppressOverlaps(mode, &s.x0[i + 1], &s.y0[i + 1], &s.x1[i + 1], &s.y1[i + 1],
+                         &s.area[i + 1], m, box, nms_thresh, &s.flag[i + 1]);
+    }
+}
+
+// 網格邊長大於任何框的邊長，重疊的框其左上角必落在相鄰的 3x3 格子內
+static void nmsGrid(NmsScratch& s, int n, float nms_thresh, NmsMode mode)
+{
+    float cell = 1.f;
+    float min_x = s.x0[0], min_y = s.y0[0];
+    float max_x = s.x0[0], max_y = s.y0[0];
+    for (int i = 0; i < n; i++)
+    {
+        cell = std::max(cell, std::max(s.x1[i] - s.x0[i], s.y1[i] - s.y0[i]));
+        min_x = std::min(min_x, s.x0[i]);
+        min_y = std::min(min_y, s.y0[i]);
+        max_x = std::max(max_x, s.x0[i]);
+        max_y = std::max(max_y, s.y0[i]);
+    }
+    cell += 1.f;
+
+    int grid_w = (int)((max_x - min_x) / cell) + 1;
+    int grid_h = (int)((max_y - min_y) / cell) + 1;
+    while ((size_t)grid_w * grid_h > (size_t)n * 4)
+    {
+        cell *= 2;
+        grid_w = (int)((max_x - min_x) / cell) + 1;
+        grid_h = (int)((max_y - min_y) / cell) + 1;
+    }
+
+    float inv_cell = 1.f / cell;
+    int num_cells = grid_w * grid_h;
+    s.cell_of.resize(n);
+    s.cell_start.assign(num_cells + 1, 0);
+    for (int i = 0; i < n; i++)
+    {
+        int cx = std::min((int)((s.x0[i] - min_x) * inv_cell), grid_w - 1);
+        int cy = std::min((int)((s.y0[i] - min_y) * inv_cell), grid_h - 1);
+        s.cell_of[i] = cy * grid_w + cx;
+        s.cell_start[s.cell_of[i] + 1]++;
+    }
+    for (int c = 0; c < num_cells; c++)
+        s.cell_start[c + 1] += s.cell_start[c];
+
+    // 依排序後的索引填入，每格內的框維持分數遞減順序
+    s.cell_items.resize(n);
+    s.cell_fill.assign(s.cell_start.begin(), s.cell_start.end() - 1);
+    for (int i = 0; i < n; i++)
+        s.cell_items[s.cell_fill[s.cell_of[i]]++] = i;
+
+    for (int i = 0; i < n; i++)
+    {
+        if (s.flag[i])
+            continue;
+        int cx = s.cell_of[i] % grid_w;
+        int cy = s.cell_of[i] / grid_w;
+
+        s.cand.clear();
+        for (int y = std::max(cy - 1, 0); y <= std::min(cy + 1, grid_h - 1); y++)
+            for (int x = std::max(cx - 1, 0); x <= std::min(cx + 1, grid_w - 1); x++)
+            {
+                int c = y * grid_w + x;
+                for (int k = s.cell_start[c]; k < s.cell_start[c + 1]; k++)
+                {
+                    int j = s.cell_items[k];
+                    if (j > i && !s.flag[j])
+                        s.cand.push_back(j);
+                }
+            }
+        if (s.cand.empty())
+            continue;
+
+        int m = (int)s.cand.size();
+        s.gx0.resize(m); s.gy0.resize(m); s.gx1.resize(m); s.gy1.resize(m);
+        s.garea.resize(m);
+        s.gflag.assign(m, 0);
+        for (int k = 0; k < m; k++)
+        {
+            int j = s.cand[k];
+            s.gx0[k] = s.x0[j];
+            s.gy0[k] = s.y0[j];
+            s.gx1[k] = s.x1[j];
+            s.gy1[k] = s.y1[j];
+            s.garea[k] = s.area[j];
+        }
+        float box[5] = {s.x0[i], s.y0[i], s.x1[i], s.y1[i], s.area[i]};
+        suppressOverlaps(mode, s.gx0.data(), s.gy0.data(), s.gx1.data(), s.gy1.data(),
+                         s.garea.data(), m, box, nms_thresh, s.gflag.data());
+        for (int k = 0; k < m; k++)
+            if (s.gflag[k])
+                s.flag[s.cand[k]] = 1;
+    }
+}
+
+int nmsSoA(const BoxArray& boxes, float nms_thresh, NmsMode mode,
+           std::vector<unsigned char>& suppressed, bool use_grid)
+{
+    int n = (int)boxes.size();
+    suppressed.assign(n, 0);
+    if (n == 0)
+        return 0;
+
+    NmsScratch& s = scratch;
+    s.order.resize(n);
+    for (int i = 0; i < n; i++)
+        s.order[i] = i;
+    const float* score = boxes.score.data();
+    std::sort(s.order.begin(), s.order.end(),
+              [score](int a, int b) { return score[a] > score[b]; });
+
+    s.x0.resize(n); s.y0.resize(n); s.x1.resize(n); s.y1.resize(n);
+    s.area.resize(n);
+    for (int i = 0; i < n; i++)
+    {
+        int k = s.order[i];
+        s.x0[i] = boxes.x0[k];
+        s.y0[i] = boxes.y0[k];
+        s.x1[i] = boxes.x1[k];
+        s.y1[i] = boxes.y1[k];
+        s.area[i] = boxes.area[k];
+    }
+    s.flag.assign(n, 0);
+
+    // 框數少時直接兩兩比較較快；閾值不為正時任何框都可能被抑制，不能分桶
+    if (use_grid && n >= 64 && nms_thresh >= 0)
+        nmsGrid(s, n, nms_thresh, mode);
+    else
+        nmsDense(s, n, nms_thresh, mode);
+
+    int kept = 0;
+    for (int i = 0; i < n; i++)
+    {
+        suppressed[s.order[i]] = s.flag[i];
+        kept += !s.flag[i];
+    }
+    return kept;
+}
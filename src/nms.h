@@ -0,0 +1,33 @@
+#ifndef NMS_H
+#define NMS_H
+
+#include <vector>
+#include "base.h"
+
+enum class NmsMode {
+    Union,  // IoU = inter / (area1 + area2 - inter)
+    Min     // IoU = inter / min(area1, area2)
+};
+
+// SoA 格式的候選框陣列，座標以 float 儲存以便 SIMD 計算
+struct BoxArray {
+    std::vector<float> x0, y0, x1, y1;
+    std::vector<float> score;
+    std::vector<float> area;
+    std::vector<float> reg[4];
+
+    size_t size() const { return score.size(); }
+    bool empty() const { return score.empty(); }
+    void clear();
+    void reserve(size_t n);
+    void resize(size_t n);
+    void push_back(const FaceInfo& info);
+    FaceInfo get(size_t i) const;
+};
+
+// 對 SoA 陣列做 NMS，suppressed[i] 對應原始索引，回傳保留的框數
+// use_grid 時以網格分桶，只比較相鄰格子內的框
+int nmsSoA(const BoxArray& boxes, float nms_thresh, NmsMode mode,
+           std::vector<unsigned char>& suppressed, bool use_grid = false);
+
+#endif // NMS_H
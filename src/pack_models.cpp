@@ -0,0 +1,60 @@
+#include <vector>
+#include <iostream>
+#include "config.h"
+#include "model_bundle.h"
+
+void printUsage() {
+    std::cout << "Model Bundle Packer" << std::endl;
+    std::cout << "Usage:" << std::endl;
+    std::cout << "  ./pack_models [-c config.json] <output_bundle>" << std::endl;
+    std::cout << "Packs det1-det4 and arcface (int8 variants if models.int8 is set) into one" << std::endl;
+    std::cout << "page-aligned file that can be set as models.bundle." << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string config_file = "config.json";
+    std::vector<std::string> args;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-c" && i + 1 < argc) {
+            config_file = argv[++i];
+        } else {
+            args.push_back(arg);
+        }
+    }
+    if (args.size() != 1) {
+        printUsage();
+        return -1;
+    }
+
+    Config& config = Config::getInstance();
+    if (!config.loadConfig(config_file)) {
+        std::cerr << "Failed to load config file: " << config_file << std::endl;
+        return -1;
+    }
+
+    std::vector<std::string> names = {"det1", "det2", "det3", "det4", "arcface"};
+    std::vector<std::string> param_files = {
+        config.getNetModelPath(config.mtcnn_det1_param),
+        config.getNetModelPath(config.mtcnn_det2_param),
+        config.getNetModelPath(config.mtcnn_det3_param),
+        config.getNetModelPath(config.mtcnn_det4_param),
+        config.getNetModelPath(config.arcface_param)
+    };
+    std::vector<std::string> bin_files = {
+        config.getNetModelPath(config.mtcnn_det1_bin),
+        config.getNetModelPath(config.mtcnn_det2_bin),
+        config.getNetModelPath(config.mtcnn_det3_bin),
+        config.getNetModelPath(config.mtcnn_det4_bin),
+        config.getNetModelPath(config.arcface_bin)
+    };
+
+    if (!ModelBundle::pack(args[0], names, param_files, bin_files)) {
+        std::cerr << "Failed to pack models" << std::endl;
+        return -1;
+    }
+    std::cout << "Model bundle written to " << args[0] << std::endl;
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include "pool_allocator.h"
+#include <vector>
+#include <algorithm>
+
+static std::mutex registry_mutex;
+static std::vector<WorkerAllocators*> registry;
+
+WorkerAllocators::WorkerAllocators()
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    registry.push_back(this);
+}
+
+WorkerAllocators::~WorkerAllocators()
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    registry.erase(std::remove(registry.begin(), registry.end(), this), registry.end());
+}
+
+static double hitRate(size_t hits, size_t misses)
+{
+    size_t total = hits + misses;
+    return total ? (double)hits / total : 0.0;
+}
+
+double AllocatorStats::blobHitRate() const
+{
+    return hitRate(blob_hits, blob_misses);
+}
+
+double AllocatorStats::workspaceHitRate() const
+{
+    return hitRate(workspace_hits, workspace_misses);
+}
+
+WorkerAllocators& workerAllocators()
+{
+    static thread_local WorkerAllocators allocators;
+    return allocators;
+}
+
+void useWorkerAllocators(ncnn::Extractor& ex)
+{
+    WorkerAllocators& allocators = workerAllocators();
+    ex.set_blob_allocator(&allocators.blob);
+    ex.set_workspace_allocator(&allocators.workspace);
+}
+
+AllocatorStats getAllocatorStats()
+{
+    AllocatorStats stats;
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (auto it = registry.begin(); it != registry.end(); it++)
+    {
+#if FACE_POOL_STATS
+        stats.blob_hits += (*it)->blob.hits;
+        stats.blob_misses += (*it)->blob.misses;
+        stats.workspace_hits += (*it)->workspace.hits;
+        stats.workspace_misses += (*it)->workspace.misses;
+#endif
+        stats.workers++;
+    }
+    return stats;
+}
@@ -0,0 +1,75 @@
+#ifndef POOL_ALLOCATOR_H
+#define POOL_ALLOCATOR_H
+
+#include <mutex>
+#include <atomic>
+#include <unordered_set>
+#include "allocator.h"
+#include "net.h"
+
+#if FACE_POOL_STATS
+// 在 ncnn 池配置器外加上命中統計：回傳曾經配置過的位址即為命中。
+// 每次配置都要查表，只編進 bench (FACE_POOL_STATS)，main 直接使用 ncnn 的池
+template<class Pool>
+class CountingPoolAllocator : public Pool {
+public:
+    virtual void* fastMalloc(size_t size)
+    {
+        void* ptr = Pool::fastMalloc(size);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (seen.insert(ptr).second)
+            misses++;
+        else
+            hits++;
+        return ptr;
+    }
+
+    void clear()
+    {
+        Pool::clear();
+        std::lock_guard<std::mutex> lock(mutex);
+        seen.clear();
+    }
+
+    std::atomic<size_t> hits{0};
+    std::atomic<size_t> misses{0};
+
+private:
+    std::mutex mutex;
+    std::unordered_set<void*> seen;
+};
+#endif
+
+// 每個工作執行緒一組 blob 與 workspace 池，跨幀重複使用
+struct WorkerAllocators {
+#if FACE_POOL_STATS
+    CountingPoolAllocator<ncnn::UnlockedPoolAllocator> blob;
+    CountingPoolAllocator<ncnn::PoolAllocator> workspace;
+#else
+    ncnn::UnlockedPoolAllocator blob;
+    ncnn::PoolAllocator workspace;
+#endif
+
+    WorkerAllocators();
+    ~WorkerAllocators();
+};
+
+struct AllocatorStats {
+    size_t blob_hits = 0, blob_misses = 0;
+    size_t workspace_hits = 0, workspace_misses = 0;
+    int workers = 0;
+
+    double blobHitRate() const;
+    double workspaceHitRate() const;
+};
+
+// 取得目前執行緒的配置器組
+WorkerAllocators& workerAllocators();
+
+// 將目前執行緒的池配置器設給 extractor
+void useWorkerAllocators(ncnn::Extractor& ex);
+
+// 彙總所有執行緒的命中統計；未定義 FACE_POOL_STATS 時只有 workers
+AllocatorStats getAllocatorStats();
+
+#endif // POOL_ALLOCATOR_H
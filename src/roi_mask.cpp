@@ -0,0 +1,61 @@
+#include "roi_mask.h"
+#include <cmath>
+#include <algorithm>
+
+RoiMask::RoiMask(const std::vector<RoiPolygon>& polygons)
+{
+    // 少於三個頂點的多邊形沒有面積，直接略過
+    for (auto it = polygons.begin(); it != polygons.end(); it++)
+        if (it->size() >= 6)
+            this->polygons.push_back(*it);
+}
+
+RoiMask RoiMask::forSource(const std::string& source)
+{
+    return RoiMask(Config::getInstance().getRoiPolygons(source));
+}
+
+cv::Rect RoiMask::bounds(int img_w, int img_h) const
+{
+    if (polygons.empty())
+        return cv::Rect(0, 0, img_w, img_h);
+
+    float u0 = 1, v0 = 1, u1 = 0, v1 = 0;
+    for (auto poly = polygons.begin(); poly != polygons.end(); poly++) {
+        for (size_t i = 0; i + 1 < poly->size(); i += 2) {
+            u0 = std::min(u0, (*poly)[i]);
+            u1 = std::max(u1, (*poly)[i]);
+            v0 = std::min(v0, (*poly)[i + 1]);
+            v1 = std::max(v1, (*poly)[i + 1]);
+        }
+    }
+    int x0 = std::max(0, (int)std::floor(u0 * img_w));
+    int y0 = std::max(0, (int)std::floor(v0 * img_h));
+    int x1 = std::min(img_w, (int)std::ceil(u1 * img_w));
+    int y1 = std::min(img_h, (int)std::ceil(v1 * img_h));
+    if (x1 <= x0 || y1 <= y0)
+        return cv::Rect();
+    return cv::Rect(x0, y0, x1 - x0, y1 - y0);
+}
+
+bool RoiMask::contains(float u, float v) const
+{
+    if (polygons.empty())
+        return true;
+
+    // 射線法：自該點向右的水平射線與邊相交奇數次即在多邊形內
+    for (auto poly = polygons.begin(); poly != polygons.end(); poly++) {
+        const std::vector<float>& p = *poly;
+        size_t n = p.size() / 2;
+        bool inside = false;
+        for (size_t i = 0, j = n - 1; i < n; j = i++) {
+            float ui = p[2 * i], vi = p[2 * i + 1];
+            float uj = p[2 * j], vj = p[2 * j + 1];
+            if ((vi > v) != (vj > v) && u < (uj - ui) * (v - vi) / (vj - vi) + ui)
+                inside = !inside;
+        }
+        if (inside)
+            return true;
+    }
+    return false;
+}
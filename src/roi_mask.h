@@ -0,0 +1,32 @@
+#ifndef ROI_MASK_H
+#define ROI_MASK_H
+
+#include <string>
+#include <vector>
+#include "base.h"
+#include "config.h"
+
+// 偵測區域遮罩：由多個多邊形 (矩形也轉成四邊形) 組成，座標為相對於影格寬高的 0~1 比例，
+// 因此與影像解析度或縮小解碼的倍率無關
+class RoiMask {
+public:
+    RoiMask() {}
+    RoiMask(const std::vector<RoiPolygon>& polygons);
+
+    // 依輸入來源 (圖片或影格目錄路徑) 取得設定檔中的遮罩，沒有設定時為空遮罩
+    static RoiMask forSource(const std::string& source);
+
+    // 空遮罩代表整張影格
+    bool empty() const { return polygons.empty(); }
+
+    // 所有區域在 img_w × img_h 影格上的外接矩形 (像素，已裁切到影格內)
+    cv::Rect bounds(int img_w, int img_h) const;
+
+    // 正規化座標 (u, v) 是否落在任一區域內
+    bool contains(float u, float v) const;
+
+private:
+    std::vector<RoiPolygon> polygons;
+};
+
+#endif // ROI_MASK_H
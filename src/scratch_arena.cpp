@@ -0,0 +1,137 @@
+#include "scratch_arena.h"
+#include <mutex>
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+static const size_t SCRATCH_ALIGN = 16;
+static const size_t SCRATCH_MIN_BLOCK = 64 * 1024;
+
+static std::mutex registry_mutex;
+static std::vector<ScratchArena*> registry;
+
+static size_t alignUp(size_t v)
+{
+    return (v + SCRATCH_ALIGN - 1) & ~(SCRATCH_ALIGN - 1);
+}
+
+ScratchArena::ScratchArena() : current(0), offset(0), used_bytes(0)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    registry.push_back(this);
+}
+
+ScratchArena::~ScratchArena()
+{
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.erase(std::remove(registry.begin(), registry.end(), this), registry.end());
+    }
+    for (auto it = blocks.begin(); it != blocks.end(); it++)
+        free(it->data);
+}
+
+void ScratchArena::addBlock(size_t size)
+{
+    Block block;
+    block.size = alignUp(size);
+    block.data = (unsigned char*)aligned_alloc(SCRATCH_ALIGN, block.size);
+    if (!block.data)
+        throw std::bad_alloc();
+    blocks.push_back(block);
+    capacity_bytes += block.size;
+    heap_allocations++;
+}
+
+void* ScratchArena::allocate(size_t size)
+{
+    size = alignUp(size ? size : 1);
+    while (blocks.empty() || offset + size > blocks[current].size) {
+        // 之後的區塊夠大就沿用，否則在尾端新增至少加倍的區塊
+        if (!blocks.empty() && current + 1 < blocks.size()) {
+            current++;
+            offset = 0;
+            continue;
+        }
+        addBlock(std::max(std::max(size, SCRATCH_MIN_BLOCK), (size_t)capacity_bytes));
+        current = blocks.size() - 1;
+        offset = 0;
+    }
+
+    void* ptr = blocks[current].data + offset;
+    offset += size;
+    used_bytes += size;
+    if (used_bytes > peak_bytes)
+        peak_bytes = used_bytes;
+    return ptr;
+}
+
+void ScratchArena::coalesce()
+{
+    if (blocks.size() <= 1)
+        return;
+    // 可能在 Scope 解構時呼叫，不能拋出例外：配置不到合併區塊就保留原本的區塊
+    size_t total = capacity_bytes;
+    unsigned char* merged = (unsigned char*)aligned_alloc(SCRATCH_ALIGN, total);
+    if (!merged)
+        return;
+    for (auto it = blocks.begin(); it != blocks.end(); it++)
+        free(it->data);
+    blocks.clear();
+    Block block;
+    block.data = merged;
+    block.size = total;
+    blocks.push_back(block);
+    heap_allocations++;
+}
+
+void ScratchArena::reset()
+{
+    current = 0;
+    offset = 0;
+    used_bytes = 0;
+    coalesce();
+}
+
+ScratchArena::Scope::Scope(ScratchArena& arena)
+    : arena(arena), block(arena.current), offset(arena.offset), used(arena.used_bytes)
+{
+}
+
+ScratchArena::Scope::~Scope()
+{
+    // 最外層範圍結束時順便合併區塊，等同於一次 reset
+    if (used == 0) {
+        arena.reset();
+        return;
+    }
+    arena.current = block;
+    arena.offset = offset;
+    arena.used_bytes = used;
+}
+
+ScratchArena& scratchArena()
+{
+    static thread_local ScratchArena arena;
+    return arena;
+}
+
+void resetScratchArena()
+{
+    scratchArena().reset();
+}
+
+ScratchStats getScratchStats()
+{
+    ScratchStats stats;
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (auto it = registry.begin(); it != registry.end(); it++)
+    {
+        stats.capacity += (*it)->capacity();
+        stats.peak = std::max(stats.peak, (*it)->peak());
+        stats.heap_allocations += (*it)->heapAllocations();
+        stats.mat_allocations += (*it)->matAllocations();
+        stats.threads++;
+    }
+    return stats;
+}
@@ -0,0 +1,85 @@
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+// 影像輔助函式的執行緒區域暫存區：依序切出記憶體、只增不減，
+// 本幀用到多個區塊時在 reset 合併成一塊，穩定後不再向 heap 配置
+class ScratchArena {
+public:
+    ScratchArena();
+    ~ScratchArena();
+
+    // 取得 size 位元組 (16 位元組對齊)，目前區塊不足時改用下一個或新配置的區塊
+    void* allocate(size_t size);
+
+    template<typename T>
+    T* allocate(size_t count) { return static_cast<T*>(allocate(count * sizeof(T))); }
+
+    // 歸還所有暫存，之後取得的記憶體會覆蓋先前的內容
+    void reset();
+
+    // 離開範圍時歸還範圍內取得的暫存
+    class Scope {
+    public:
+        explicit Scope(ScratchArena& arena);
+        ~Scope();
+    private:
+        ScratchArena& arena;
+        size_t block, offset, used;
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    size_t used() const { return used_bytes; }
+    size_t capacity() const { return capacity_bytes; }
+    size_t peak() const { return peak_bytes; }
+    size_t heapAllocations() const { return heap_allocations; }
+
+    // 影像輔助函式的輸出張量重新配置時呼叫，與暫存區塊一起統計
+    void countMatAllocation() { mat_allocations++; }
+    size_t matAllocations() const { return mat_allocations; }
+
+private:
+    struct Block {
+        unsigned char* data;
+        size_t size;
+    };
+    std::vector<Block> blocks;
+    size_t current;
+    size_t offset;
+    size_t used_bytes;
+
+    // 供其他執行緒彙總統計
+    std::atomic<size_t> capacity_bytes{0};
+    std::atomic<size_t> peak_bytes{0};
+    std::atomic<size_t> heap_allocations{0};
+    std::atomic<size_t> mat_allocations{0};
+
+    void addBlock(size_t size);
+    void coalesce();
+
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+};
+
+struct ScratchStats {
+    size_t capacity = 0;           // 所有執行緒目前保留的位元組
+    size_t peak = 0;               // 單一執行緒的最高使用量
+    size_t heap_allocations = 0;   // 向 heap 配置區塊的總次數
+    size_t mat_allocations = 0;    // 輸出張量重新配置的總次數
+    int threads = 0;
+};
+
+// 目前執行緒的暫存區
+ScratchArena& scratchArena();
+
+// 每幀開始時呼叫，歸還目前執行緒的暫存
+void resetScratchArena();
+
+// 彙總所有執行緒的暫存區統計
+ScratchStats getScratchStats();
+
+#endif // SCRATCH_ARENA_H
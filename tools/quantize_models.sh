@@ -0,0 +1,26 @@
+#!/bin/bash
+# 以 calibrate 產生的 table 將所有模型轉為 int8
+# Usage: bash tools/quantize_models.sh <table_dir> [models_dir]
+project_root=$(pwd)
+table_dir=${1:?"Usage: $0 <table_dir> [models_dir]"}
+models_dir=${2:-${project_root}/models}
+suffix=${INT8_SUFFIX:-"-int8"}
+ncnn2int8=${NCNN2INT8:-${project_root}/lib/ncnn/build/tools/quantize/ncnn2int8}
+
+if [ ! -x "${ncnn2int8}" ]; then
+    echo "ncnn2int8 not found: ${ncnn2int8} (build ncnn for the host with tools/build_ncnn.sh or set NCNN2INT8)"
+    exit 1
+fi
+
+for net in det1 det2 det3 det4 mobilefacenet; do
+    table=${table_dir}/${net}.table
+    if [ ! -f "${table}" ]; then
+        echo "Skip ${net}: ${table} not found"
+        continue
+    fi
+    ${ncnn2int8} \
+        ${models_dir}/${net}.param ${models_dir}/${net}.bin \
+        ${models_dir}/${net}${suffix}.param ${models_dir}/${net}${suffix}.bin \
+        ${table}
+    echo "Quantized ${net} -> ${models_dir}/${net}${suffix}.param"
+done